@@ -0,0 +1,86 @@
+#ifndef DAMAGE_TRACKER_H
+#define DAMAGE_TRACKER_H
+
+#include <algorithm>
+#include <vector>
+
+// Framebuffer-space rectangle, origin bottom-left like glScissor.
+struct DamageRect {
+   int x, y, width, height;
+
+   int right() const { return x + width; }
+   int top() const { return y + height; }
+   long long area() const { return (long long)width * height; }
+};
+
+// Collects the regions that changed since the last repaint. Overlapping
+// rectangles are merged; past kMaxRects, or once the damage covers most of
+// the surface, it degrades to a single full repaint since scissored passes
+// stop paying off.
+class DamageTracker {
+public:
+   static constexpr size_t kMaxRects = 8;
+
+   void setSurface(int w, int h) {
+      surfaceWidth = w;
+      surfaceHeight = h;
+      addFull();
+   }
+
+   void add(DamageRect r) {
+      if (full) return;
+      // Clip to the surface
+      int x0 = std::max(r.x, 0), y0 = std::max(r.y, 0);
+      int x1 = std::min(r.right(), surfaceWidth), y1 = std::min(r.top(), surfaceHeight);
+      if (x1 <= x0 || y1 <= y0) return;
+      r = {x0, y0, x1 - x0, y1 - y0};
+
+      // Absorb every rect that overlaps the new one, repeating as it grows
+      for (size_t i = 0; i < rects.size();) {
+         if (overlaps(rects[i], r)) {
+            r = unite(rects[i], r);
+            rects.erase(rects.begin() + i);
+            i = 0;
+         } else {
+            ++i;
+         }
+      }
+      rects.push_back(r);
+
+      long long covered = 0;
+      for (const auto& d : rects) covered += d.area();
+      if (rects.size() > kMaxRects || covered * 4 > (long long)surfaceWidth * surfaceHeight * 3) addFull();
+   }
+
+   void addFull() {
+      full = true;
+      rects.assign(1, DamageRect{0, 0, surfaceWidth, surfaceHeight});
+   }
+
+   bool empty() const { return rects.empty(); }
+   bool isFull() const { return full; }
+   const std::vector<DamageRect>& regions() const { return rects; }
+
+   void clear() {
+      rects.clear();
+      full = false;
+   }
+
+private:
+   std::vector<DamageRect> rects;
+   int surfaceWidth = 0;
+   int surfaceHeight = 0;
+   bool full = false;
+
+   static bool overlaps(const DamageRect& a, const DamageRect& b) {
+      return a.x < b.right() && b.x < a.right() && a.y < b.top() && b.y < a.top();
+   }
+
+   static DamageRect unite(const DamageRect& a, const DamageRect& b) {
+      int x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+      int x1 = std::max(a.right(), b.right()), y1 = std::max(a.top(), b.top());
+      return {x0, y0, x1 - x0, y1 - y0};
+   }
+};
+
+#endif
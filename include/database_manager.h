@@ -6,10 +6,18 @@
 #include <QSqlQuery>
 #include <QDebug>
 #include <QString>
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 class DatabaseManager {
 public:
+   struct LogRow {
+      int64_t id;
+      std::string message;
+   };
+
    DatabaseManager(const QString& path) {
       db = QSqlDatabase::addDatabase("QSQLITE");
       db.setDatabaseName(path);
@@ -37,8 +45,59 @@ public:
       return true;
    }
 
+   // Up to limit rows in id order: those with id >= fromId, or going
+   // backwards those with id < fromId. Pages are found by seeking the
+   // primary key rather than with OFFSET, so any page of a table with
+   // millions of rows costs the same as the first.
+   std::vector<LogRow> fetchLogs(int64_t fromId, int limit, bool backward = false) {
+      std::vector<LogRow> rows;
+      if (!prepared) prepareQueries();
+      QSqlQuery& query = backward ? pageBackward : pageForward;
+      query.bindValue(":from", fromId);
+      query.bindValue(":limit", limit);
+      if (!query.exec()) {
+         qWarning() << "Log page query failed:" << query.lastError().text();
+         return rows;
+      }
+      rows.reserve(size_t(std::max(limit, 0)));
+      while (query.next()) rows.push_back(LogRow{int64_t(query.value(0).toLongLong()), query.value(1).toString().toStdString()});
+      query.finish();
+      if (backward) std::reverse(rows.begin(), rows.end());
+      return rows;
+   }
+
+   // Lowest and highest id in the logs table; false when it is empty.
+   // Both come off the ends of the primary key index, not a table scan.
+   bool logIdRange(int64_t& first, int64_t& last) {
+      if (!prepared) prepareQueries();
+      if (!idRange.exec() || !idRange.next() || idRange.value(0).isNull()) {
+         idRange.finish();
+         return false;
+      }
+      first = int64_t(idRange.value(0).toLongLong());
+      last = int64_t(idRange.value(1).toLongLong());
+      idRange.finish();
+      return true;
+   }
+
 private:
    QSqlDatabase db;
+   // Prepared once on first use; the log viewer runs them every scroll
+   QSqlQuery pageForward, pageBackward, idRange;
+   bool prepared = false;
+
+   void prepareQueries() {
+      pageForward = QSqlQuery(db);
+      pageForward.setForwardOnly(true);
+      pageForward.prepare("SELECT id, msg FROM logs WHERE id >= :from ORDER BY id LIMIT :limit");
+      pageBackward = QSqlQuery(db);
+      pageBackward.setForwardOnly(true);
+      pageBackward.prepare("SELECT id, msg FROM logs WHERE id < :from ORDER BY id DESC LIMIT :limit");
+      idRange = QSqlQuery(db);
+      idRange.setForwardOnly(true);
+      idRange.prepare("SELECT (SELECT MIN(id) FROM logs), (SELECT MAX(id) FROM logs)");
+      prepared = true;
+   }
 
    bool createTable() {
       QSqlQuery query;
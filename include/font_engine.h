@@ -1,51 +1,422 @@
+#ifndef FONT_ENGINE_H
+#define FONT_ENGINE_H
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_ADVANCES_H
+
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FONT_ENGINE_SSE2 1
+#endif
+
+#include "font_registry.h"
+#include "glyph_atlas.h"
+#include "sdf_generator.h"
 
 class FontEngine {
 public:
-   FontEngine() : ft(nullptr), face(nullptr) {}
+   // Horizontal pen positions of bitmap glyphs are quantized to this many
+   // bins per pixel by default; each bin in use is its own atlas entry
+   static constexpr int kSubpixelBins = 4;
+   static constexpr int kMaxSubpixelBins = 8;
 
-   // Destructor ensures cleanup happens automatically
-   ~FontEngine() {
-      if (face) FT_Done_Face(face);
-      if (ft) FT_Done_FreeType(ft);
+   // Distance-field glyphs are built once at this size and scaled to any
+   // other; the spread is how far (in those pixels) the field reaches.
+   static constexpr int kSdfSize = 32;
+   static constexpr int kSdfSpread = 4;
+   // Subpixel value reserved for distance-field entries in the atlas
+   static constexpr uint8_t kSdfBin = 0xFF;
+
+   // Glyphs go into sharedAtlas if given, so several faces can share one
+   // texture; otherwise the engine owns an atlas of its own. Likewise engines
+   // on one thread can share a FontRegistry so a file/size opens one face.
+   explicit FontEngine(GlyphAtlas* sharedAtlas = nullptr, FontRegistry* sharedRegistry = nullptr)
+   : face(nullptr), atlas(sharedAtlas), registry(sharedRegistry), sdf(JobSystem::shared(), kSdfSpread) {
+      if (!atlas) {
+         ownAtlas.reset(new GlyphAtlas());
+         atlas = ownAtlas.get();
+      }
+      if (!registry) {
+         ownRegistry.reset(new FontRegistry());
+         registry = ownRegistry.get();
+      }
    }
 
+   // The face comes from the engine's FontRegistry, which maps the file once
+   // per process and keeps an FT_Size per pixel size
    bool init(const char* fontPath, int size) {
-      if (FT_Init_FreeType(&ft)) {
-         qCritical() << "Could not init FreeType Library";
-         return false;
+      face = registry->face(fontPath);
+      if (!face) return false;
+      registry->activate(face, size);
+      this->fontPath = fontPath;
+      pixelSize = size;
+      faceId = nextFaceId();
+      buildMetrics();
+      return true;
+   }
+
+   // Width in pixels of the widest line of UTF-8 text. Uses only the tables
+   // built by init(), never FreeType, so it is cheap and safe to call from
+   // any thread. size 0 measures bitmap glyphs at the engine's pixel size
+   // (whole-pixel advances with a single subpixel bin, as TextRenderer
+   // places them); any other size measures distance-field text scaled to
+   // that size.
+   float measure(std::string_view text, float size = 0.0f) const {
+      const bool scaled = scaledSize(size);
+      const int32_t* dense = scaled ? metrics.unitAdvance : metrics.pixelAdvance;
+#if defined(FONT_ENGINE_SSE2)
+      const int16_t* pairs = metrics.kerning.empty() ? nullptr : (scaled ? metrics.kerning : metrics.pixelKerning).data();
+      const char* scalarUntil = text.data(); // a block failed the check: decode up to here first
+#endif
+      int64_t line = 0, widest = 0;
+      uint32_t previous = 0;
+      const char* p = text.data();
+      const char* end = p + text.size();
+      while (p < end) {
+#if defined(FONT_ENGINE_SSE2)
+         if (p >= scalarUntil) {
+            p = sumAsciiBlocks(p, end, dense, pairs, scaled, line, previous);
+            if (p == end) break;
+            scalarUntil = p + 16;
+         }
+#endif
+         uint32_t codepoint = decodeUtf8(p, end);
+         if (codepoint == '\n') {
+            widest = std::max(widest, line);
+            line = 0;
+            previous = 0;
+            continue;
+         }
+         line += codepoint < 256 ? dense[codepoint] : wideAdvance(codepoint, scaled);
+         if (previous) line += kerningUnits(previous, codepoint, scaled);
+         previous = metrics.kerning.empty() ? 0 : codepoint;
+      }
+      widest = std::max(widest, line);
+      return float(double(widest) * (scaled ? double(size) / double(metrics.unitsPerEm) : 1.0 / 64.0));
+   }
+
+   // Kerning between two codepoints in pixels, from the same tables as
+   // measure(). Only Latin-1 pairs of fonts with a kern table are kerned.
+   float kerning(uint32_t left, uint32_t right, float size = 0.0f) const {
+      if (metrics.kerning.empty()) return 0.0f;
+      bool scaled = scaledSize(size);
+      double units = double(kerningUnits(left, right, scaled));
+      return float(units * (scaled ? double(size) / double(metrics.unitsPerEm) : 1.0 / 64.0));
+   }
+
+   bool hasKerning() const { return !metrics.kerning.empty(); }
+
+   // Pen advance of one codepoint in pixels, as measure() counts it.
+   // TextRenderer advances by this too, so drawn and measured widths agree.
+   float advance(uint32_t codepoint, float size = 0.0f) const {
+      bool scaled = scaledSize(size);
+      int32_t value = codepoint < 256 ? (scaled ? metrics.unitAdvance : metrics.pixelAdvance)[codepoint] : wideAdvance(codepoint, scaled);
+      return float(double(value) * (scaled ? double(size) / double(metrics.unitsPerEm) : 1.0 / 64.0));
+   }
+
+   // Baseline-to-baseline distance in pixels
+   float lineHeight(float size = 0.0f) const {
+      if (!face) return 0.0f;
+      return float(face->height) * (size > 0.0f ? size : float(pixelSize)) / float(face->units_per_EM);
+   }
+
+   // Next codepoint of UTF-8 text, advancing p; malformed input yields U+FFFD
+   static uint32_t decodeUtf8(const char*& p, const char* end) {
+      uint8_t lead = uint8_t(*p++);
+      if (lead < 0x80) return lead;
+      int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+      if (extra < 0 || end - p < extra) return 0xFFFD;
+      uint32_t codepoint = lead & (0x3F >> extra);
+      for (int i = 0; i < extra; ++i) {
+         uint8_t next = uint8_t(*p);
+         if ((next & 0xC0) != 0x80) return 0xFFFD;
+         codepoint = codepoint << 6 | (next & 0x3F);
+         ++p;
       }
-      if (FT_New_Face(ft, fontPath, 0, &face)) {
-         qCritical() << "Failed to load font:" << fontPath;
+      return codepoint;
+   }
+
+   // The glyph for a codepoint from the atlas, rasterized only the first
+   // time this (face, size, codepoint, subpixel bin) is asked for. Bin b is
+   // the outline shifted right by b / getSubpixelBins() px.
+   const Glyph* glyph(uint32_t codepoint, uint8_t bin = 0) {
+      return lookup(codepoint, uint16_t(pixelSize), subpixelOffset(bin));
+   }
+
+   // GlyphKey::subpixel of a bin: its shift in 1/64 px
+   uint8_t subpixelOffset(uint8_t bin) const { return uint8_t(bin % subpixelBins * (64 / subpixelBins)); }
+
+   // Splits a pen x position into the whole pixel to draw a bitmap glyph at
+   // and the nearest subpixel bin (for glyph()) covering the rest
+   float snapToBin(float x, uint8_t& bin) const {
+      float steps = std::floor(x * float(subpixelBins) + 0.5f);
+      float origin = std::floor(steps / float(subpixelBins));
+      bin = uint8_t(steps - origin * float(subpixelBins));
+      return origin;
+   }
+
+   // Bins per pixel for bitmap glyphs; 1 snaps every glyph to whole pixels.
+   // Must divide 64 (FreeType's 26.6 units) and be at most
+   // kMaxSubpixelBins. With one bin, bitmap advances and kerning round to
+   // whole pixels so snapped glyphs stay evenly spaced; with more, pens
+   // move by the unrounded advances and only each glyph's drawn position
+   // is quantized.
+   bool setSubpixelBins(int bins) {
+      if (bins < 1 || bins > kMaxSubpixelBins || 64 % bins != 0) {
+         qCritical() << "Unsupported subpixel bin count:" << bins;
          return false;
       }
-      FT_Set_Pixel_Sizes(face, 0, size);
+      subpixelBins = bins;
       return true;
    }
 
-   // Method to load a specific character and print its info
-   bool loadAndPrintGlyph(char c) {
-      if (!face) return false;
+   int getSubpixelBins() const { return subpixelBins; }
 
-      if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-         qCritical() << "Failed to load Glyph:" << c;
-         return false;
+   // Distance-field glyph for a codepoint, one entry for every size. Metrics
+   // are in kSdfSize pixels and include the spread on each side: draw with a
+   // scale of targetSize / kSdfSize and threshold the field at 0.5.
+   const Glyph* sdfGlyph(uint32_t codepoint) {
+      return lookup(codepoint, uint16_t(kSdfSize), kSdfBin);
+   }
+
+   // When set, atlas misses go to handler (e.g. a GlyphRasterizer) and
+   // glyph()/sdfGlyph() return null until the result has been published,
+   // instead of rasterizing on the calling thread.
+   void setMissHandler(std::function<void(const GlyphKey&)> handler) { missHandler = std::move(handler); }
+
+   // A glyph rendered outside the atlas: bitmap pixels plus metrics
+   struct Raster {
+      std::vector<uint8_t> pixels;
+      int width = 0, height = 0;
+      Glyph metrics;
+   };
+
+   // Renders key's glyph with a face from fonts, both owned by the calling
+   // thread (FreeType objects are not thread-safe). Bitmap keys honour the
+   // subpixel shift; kSdfBin keys produce a distance field. Leaves the face
+   // at key.pixelSize.
+   static bool rasterize(FontRegistry& fonts, FT_Face face, SdfGenerator& sdf, const GlyphKey& key, Raster& out) {
+      if (!fonts.activate(face, key.pixelSize)) return false;
+
+      if (key.subpixel == kSdfBin) {
+         if (FT_Load_Char(face, key.codepoint, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING)) return false;
+         SdfGenerator::Field field;
+         if (!sdf.generate(face->glyph, field)) return false;
+         out.pixels = std::move(field.pixels);
+         out.width = field.width;
+         out.height = field.height;
+         out.metrics.bearingX = field.bearingX;
+         out.metrics.bearingY = field.bearingY;
+         out.metrics.advance = float(face->glyph->advance.x) / 64.0f;
+         return true;
+      }
+
+      if (key.subpixel) {
+         FT_Vector shift = {FT_Pos(key.subpixel), 0};
+         FT_Set_Transform(face, nullptr, &shift);
+      }
+      FT_Error error = FT_Load_Char(face, key.codepoint, FT_LOAD_RENDER);
+      if (key.subpixel) FT_Set_Transform(face, nullptr, nullptr);
+      if (error) return false;
+
+      const FT_Bitmap& bitmap = face->glyph->bitmap;
+      out.width = int(bitmap.width);
+      out.height = int(bitmap.rows);
+      out.pixels.resize(size_t(out.width) * out.height);
+      for (int row = 0; row < out.height; ++row) {
+         std::memcpy(&out.pixels[size_t(row) * out.width], bitmap.buffer + std::ptrdiff_t(row) * bitmap.pitch, size_t(out.width));
       }
+      out.metrics.bearingX = face->glyph->bitmap_left;
+      out.metrics.bearingY = face->glyph->bitmap_top;
+      out.metrics.advance = float(face->glyph->advance.x) / 64.0f;
+      return true;
+   }
+
+   // Method to load a specific character and print its info
+   bool loadAndPrintGlyph(char c) {
+      const Glyph* g = glyph(uint8_t(c));
+      if (!g) return false;
 
-      FT_Bitmap& bitmap = face->glyph->bitmap;
       qDebug() << "Successfully loaded glyph:" << c;
-      qDebug() << "Width:" << bitmap.width;
-      qDebug() << "Rows:" << bitmap.rows;
-      qDebug() << "Pitch:" << bitmap.pitch;
+      qDebug() << "Width:" << g->width;
+      qDebug() << "Rows:" << g->height;
+      qDebug() << "Atlas position:" << g->x << g->y;
 
       return true;
    }
 
    // Getter in case you need raw access to the face (e.g. for texture generation)
    FT_Face getFace() const { return face; }
+   FontRegistry& getRegistry() { return *registry; }
+
+   GlyphAtlas& getAtlas() { return *atlas; }
+   const std::string& getFontPath() const { return fontPath; }
+   int getPixelSize() const { return pixelSize; }
+   uint32_t getFaceId() const { return faceId; }
+
+   // FreeType rasterizations so far; atlas hits don't count
+   uint64_t rasterizedGlyphs() const { return rasterized; }
+
+   const SdfGenerator& getSdfGenerator() const { return sdf; }
 
 private:
-   FT_Library ft;
    FT_Face face;
+   GlyphAtlas* atlas;
+   std::unique_ptr<GlyphAtlas> ownAtlas;
+   FontRegistry* registry;
+   std::unique_ptr<FontRegistry> ownRegistry;
+   SdfGenerator sdf;
+   std::function<void(const GlyphKey&)> missHandler;
+   std::string fontPath;
+   int pixelSize = 0;
+   int subpixelBins = kSubpixelBins;
+   uint32_t faceId = 0;
+   uint64_t rasterized = 0;
+
+   const Glyph* lookup(uint32_t codepoint, uint16_t size, uint8_t subpixel) {
+      if (!face) return nullptr;
+
+      GlyphKey key;
+      key.face = faceId;
+      key.codepoint = codepoint;
+      key.pixelSize = size;
+      key.subpixel = subpixel;
+      if (const Glyph* cached = atlas->find(key)) return cached;
+      if (missHandler) {
+         missHandler(key);
+         return nullptr;
+      }
+
+      Raster raster;
+      if (!rasterize(*registry, face, sdf, key, raster)) {
+         qCritical() << "Failed to load Glyph:" << codepoint;
+         return nullptr;
+      }
+      ++rasterized;
+
+      const Glyph* cached = atlas->insert(key, raster.pixels.data(), raster.width, raster.height, raster.width, raster.metrics);
+      if (!cached) qCritical() << "Glyph atlas full, dropped glyph:" << codepoint;
+      return cached;
+   }
+
+   // Advances and kerning for measure(). Codepoints below 256 are looked up
+   // directly, everything else the font maps goes through a hash table.
+   // Unit values are font units; pixel values are 1/64 px at pixelSize,
+   // rounded to whole pixels per glyph. Unscaled advances come straight from
+   // the hmtx table, so building this costs no glyph loads.
+   struct Metrics {
+      int32_t unitAdvance[256] = {};
+      int32_t pixelAdvance[256] = {};
+      std::unordered_map<uint32_t, int32_t> wideUnits;
+      int32_t missingUnits = 0; // .notdef, for unmapped codepoints
+      int32_t unitsPerEm = 1;
+      std::vector<int16_t> kerning; // 256 x 256 font units, empty if the font has none
+      std::vector<int16_t> pixelKerning; // same pairs in 1/64 px at pixelSize
+   };
+   Metrics metrics;
+
+   int32_t toPixels(int32_t units) const {
+      return int32_t(std::lround(double(units) * pixelSize / metrics.unitsPerEm)) * 64;
+   }
+
+   // Bitmap text uses the rounded pixel tables only when glyphs snap to
+   // whole pixels; with subpixel bins it is scaled from font units
+   // like distance-field text. Returns whether the unit tables apply and
+   // sets size to the size they scale to.
+   bool scaledSize(float& size) const {
+      if (size > 0.0f) return true;
+      if (subpixelBins == 1) return false;
+      size = float(pixelSize);
+      return true;
+   }
+
+   int32_t wideAdvance(uint32_t codepoint, bool scaled) const {
+      auto it = metrics.wideUnits.find(codepoint);
+      int32_t units = it != metrics.wideUnits.end() ? it->second : metrics.missingUnits;
+      return scaled ? units : toPixels(units);
+   }
+
+#if defined(FONT_ENGINE_SSE2)
+   // SSE2 checks sixteen bytes at once for anything but ASCII and line
+   // breaks. Such a block needs no decoding: its advances, then its kerning
+   // pairs, are summed straight from the tables. Returns where the first
+   // block that failed the check, or the partial one at the end, starts.
+   const char* sumAsciiBlocks(const char* p, const char* end, const int32_t* dense, const int16_t* pairs, bool scaled,
+                              int64_t& line, uint32_t& previous) const {
+      const __m128i newline = _mm_set1_epi8('\n');
+      while (end - p >= 16) {
+         __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+         if (_mm_movemask_epi8(_mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, newline)))) return p;
+         const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+         line += int64_t(dense[b[0]]) + dense[b[1]] + dense[b[2]] + dense[b[3]] + dense[b[4]] + dense[b[5]] + dense[b[6]] + dense[b[7]] +
+                 dense[b[8]] + dense[b[9]] + dense[b[10]] + dense[b[11]] + dense[b[12]] + dense[b[13]] + dense[b[14]] + dense[b[15]];
+         if (pairs) {
+            if (previous) line += kerningUnits(previous, b[0], scaled);
+            for (int i = 1; i < 16; ++i) line += pairs[b[i - 1] * 256 + b[i]];
+            previous = b[15];
+         }
+         p += 16;
+      }
+      return p;
+   }
+#endif
+
+   int32_t kerningUnits(uint32_t left, uint32_t right, bool scaled) const {
+      if (metrics.kerning.empty() || left > 255 || right > 255) return 0;
+      return scaled ? metrics.kerning[left * 256 + right] : metrics.pixelKerning[left * 256 + right];
+   }
+
+   void buildMetrics() {
+      metrics = Metrics();
+      metrics.unitsPerEm = std::max<int32_t>(1, face->units_per_EM);
+      FT_Fixed advance = 0;
+      FT_Get_Advance(face, 0, FT_LOAD_NO_SCALE, &advance);
+      metrics.missingUnits = int32_t(advance);
+      std::fill(std::begin(metrics.unitAdvance), std::end(metrics.unitAdvance), metrics.missingUnits);
+
+      FT_UInt glyphIndex = 0;
+      for (FT_ULong c = FT_Get_First_Char(face, &glyphIndex); glyphIndex; c = FT_Get_Next_Char(face, c, &glyphIndex)) {
+         if (FT_Get_Advance(face, glyphIndex, FT_LOAD_NO_SCALE, &advance)) continue;
+         if (c < 256) metrics.unitAdvance[c] = int32_t(advance);
+         else metrics.wideUnits[uint32_t(c)] = int32_t(advance);
+      }
+      for (int c = 0; c < 256; ++c) metrics.pixelAdvance[c] = toPixels(metrics.unitAdvance[c]);
+
+      if (FT_HAS_KERNING(face)) {
+         FT_UInt glyphs[256];
+         for (int c = 0; c < 256; ++c) glyphs[c] = FT_Get_Char_Index(face, FT_ULong(c));
+         metrics.kerning.assign(256 * 256, 0);
+         for (int l = 0; l < 256; ++l) {
+            if (!glyphs[l]) continue;
+            for (int r = 0; r < 256; ++r) {
+               FT_Vector k;
+               if (glyphs[r] && !FT_Get_Kerning(face, glyphs[l], glyphs[r], FT_KERNING_UNSCALED, &k)) metrics.kerning[l * 256 + r] = int16_t(k.x);
+            }
+         }
+         metrics.pixelKerning.resize(metrics.kerning.size());
+         for (size_t i = 0; i < metrics.kerning.size(); ++i) metrics.pixelKerning[i] = int16_t(toPixels(metrics.kerning[i]));
+      }
+   }
+
+   static uint32_t nextFaceId() {
+      static std::atomic<uint32_t> next{1};
+      return next++;
+   }
 };
+
+#endif
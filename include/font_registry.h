@@ -0,0 +1,196 @@
+#ifndef FONT_REGISTRY_H
+#define FONT_REGISTRY_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SIZES_H
+
+#include <QDebug>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FONT_REGISTRY_MMAP 1
+#endif
+
+// A font file mapped read-only into memory, shared by every face opened on
+// it in any thread. open() hands out the existing mapping while anyone still
+// holds it, so a file is mapped once per process however many faces,
+// threads and sizes use it.
+class MappedFont {
+public:
+   ~MappedFont() {
+#if defined(FONT_REGISTRY_MMAP)
+      if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+   }
+
+   MappedFont(const MappedFont&) = delete;
+   MappedFont& operator=(const MappedFont&) = delete;
+
+   // Null if the file can't be read
+   static std::shared_ptr<const MappedFont> open(const std::string& path) {
+      std::lock_guard<std::mutex> lock(cacheMutex());
+      auto& cache = openFiles();
+      auto it = cache.find(path);
+      if (it != cache.end()) {
+         if (auto existing = it->second.lock()) return existing;
+      }
+
+      std::shared_ptr<MappedFont> file(new MappedFont());
+      if (!file->load(path)) return nullptr;
+      cache[path] = file;
+      return file;
+   }
+
+   const uint8_t* data() const { return bytes; }
+   size_t size() const { return length; }
+
+   // Bytes of font data currently mapped (or buffered) across the process
+   static size_t residentBytes() {
+      std::lock_guard<std::mutex> lock(cacheMutex());
+      size_t total = 0;
+      for (const auto& entry : openFiles()) {
+         if (auto file = entry.second.lock()) total += file->length;
+      }
+      return total;
+   }
+
+private:
+   const uint8_t* bytes = nullptr;
+   size_t length = 0;
+   std::vector<uint8_t> buffer; // used where mmap isn't available
+
+   MappedFont() = default;
+
+   bool load(const std::string& path) {
+#if defined(FONT_REGISTRY_MMAP)
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+      struct stat info;
+      if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+         ::close(fd);
+         return false;
+      }
+      void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (mapped == MAP_FAILED) return false;
+      bytes = static_cast<const uint8_t*>(mapped);
+      length = size_t(info.st_size);
+      return true;
+#else
+      std::ifstream file(path, std::ios::binary);
+      if (!file) return false;
+      buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+      bytes = buffer.data();
+      length = buffer.size();
+      return length != 0;
+#endif
+   }
+
+   static std::mutex& cacheMutex() {
+      static std::mutex mutex;
+      return mutex;
+   }
+
+   static std::map<std::string, std::weak_ptr<MappedFont>>& openFiles() {
+      static std::map<std::string, std::weak_ptr<MappedFont>> files;
+      return files;
+   }
+};
+
+// Faces and sizes for one thread. FreeType objects aren't thread-safe, so
+// each thread that rasterizes keeps its own registry (and FT_Library); the
+// font bytes underneath are shared through MappedFont.
+//
+// face() opens each (file, index) once. activate() switches a face to a
+// pixel size, creating one FT_Size per size on first use so switching back
+// and forth doesn't recompute scaled metrics.
+class FontRegistry {
+public:
+   struct Stats {
+      size_t faces = 0;
+      size_t sizes = 0;
+   };
+
+   FontRegistry() {
+      if (FT_Init_FreeType(&library)) {
+         qCritical() << "Could not init FreeType Library";
+         library = nullptr;
+      }
+   }
+
+   ~FontRegistry() {
+      // Frees every face and size; the mappings go after
+      if (library) FT_Done_FreeType(library);
+   }
+
+   FontRegistry(const FontRegistry&) = delete;
+   FontRegistry& operator=(const FontRegistry&) = delete;
+
+   // The face for path/faceIndex, opened over the shared mapping on first
+   // use. Null on failure.
+   FT_Face face(const std::string& path, long faceIndex = 0) {
+      if (!library) return nullptr;
+      auto key = std::make_pair(path, faceIndex);
+      auto it = faces.find(key);
+      if (it != faces.end()) return it->second;
+
+      std::shared_ptr<const MappedFont> file = MappedFont::open(path);
+      FT_Face face = nullptr;
+      if (!file || FT_New_Memory_Face(library, file->data(), FT_Long(file->size()), faceIndex, &face)) {
+         qCritical() << "Failed to load font:" << path.c_str();
+         return nullptr;
+      }
+      files.push_back(std::move(file));
+      faces[key] = face;
+      ++stats.faces;
+      return face;
+   }
+
+   // Makes face render at pixelSize
+   bool activate(FT_Face face, int pixelSize) {
+      auto key = std::make_pair(face, pixelSize);
+      auto it = sizes.find(key);
+      if (it != sizes.end()) {
+         if (face->size != it->second) FT_Activate_Size(it->second);
+         return true;
+      }
+
+      FT_Size size;
+      if (FT_New_Size(face, &size)) return false;
+      FT_Activate_Size(size);
+      if (FT_Set_Pixel_Sizes(face, 0, FT_UInt(pixelSize))) {
+         FT_Done_Size(size);
+         return false;
+      }
+      sizes[key] = size;
+      ++stats.sizes;
+      return true;
+   }
+
+   const Stats& getStats() const { return stats; }
+
+private:
+   FT_Library library = nullptr;
+   std::map<std::pair<std::string, long>, FT_Face> faces;
+   std::map<std::pair<FT_Face, int>, FT_Size> sizes;
+   // Mappings the faces read from; released only after the destructor has
+   // freed the faces
+   std::vector<std::shared_ptr<const MappedFont>> files;
+   Stats stats;
+};
+
+#endif
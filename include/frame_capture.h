@@ -0,0 +1,216 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <QImage>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gl_state_cache.h"
+
+// Reads frames back without stalling the render thread. capture() only queues
+// a glReadPixels into a pixel buffer object plus a fence; poll() hands every
+// slot whose fence has signalled to a worker thread, which encodes straight
+// out of the persistently mapped buffer. Results arrive a few frames later.
+// When every slot is still busy the capture is skipped, never waited for;
+// flush() finishes whatever is still in flight when capturing ends.
+class FrameCapture {
+public:
+   // Receives bottom-up RGBA8 rows; runs on the worker thread.
+   using Encoder = std::function<void(const uint8_t* rgba, int width, int height, const std::string& path)>;
+
+   static constexpr int kSlots = 3;
+
+   FrameCapture() : encoder(encodePng) {}
+
+   ~FrameCapture() {
+      flush();
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         stopping = true;
+      }
+      jobsCv.notify_all();
+      if (worker.joinable()) worker.join();
+      release();
+   }
+
+   FrameCapture(const FrameCapture&) = delete;
+   FrameCapture& operator=(const FrameCapture&) = delete;
+
+   void setEncoder(Encoder e) { encoder = std::move(e); }
+
+   // (Re)allocates the slots for a framebuffer size. Waits for in-flight
+   // encodes, so call it on resize rather than every frame.
+   bool init(int w, int h) {
+      if (w == width && h == height && slots[0].pbo) return true;
+      waitIdle();
+      release();
+      width = w;
+      height = h;
+
+      GLsizeiptr bytes = GLsizeiptr(w) * h * 4;
+      const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      for (Slot& slot : slots) {
+         glGenBuffers(1, &slot.pbo);
+         glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+         glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, NULL, flags);
+         slot.mapped = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags));
+         if (!slot.mapped) {
+            std::cerr << "FrameCapture: could not map pixel buffer" << std::endl;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            release();
+            return false;
+         }
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      if (!worker.joinable()) worker = std::thread(&FrameCapture::workerLoop, this);
+      return true;
+   }
+
+   // Queues a readback of the color buffer of readFramebuffer (0 = back
+   // buffer). Call after rendering, before the swap. Returns false if the
+   // frame was skipped because all slots are busy.
+   bool capture(GLStateCache& state, GLuint readFramebuffer, const std::string& path) {
+      for (Slot& slot : slots) {
+         if (slot.state.load() != State::Free) continue;
+
+         state.bindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+         state.bindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+         glPixelStorei(GL_PACK_ALIGNMENT, 4);
+         glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+         state.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+         slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+         slot.path = path;
+         slot.state = State::InFlight;
+         ++queued;
+         return true;
+      }
+      ++skipped;
+      return false;
+   }
+
+   // Once per frame on the render thread: passes finished readbacks to the worker.
+   void poll() {
+      for (Slot& slot : slots) {
+         if (slot.state.load() != State::InFlight) continue;
+         GLenum status = glClientWaitSync(slot.fence, 0, 0);
+         if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+         glDeleteSync(slot.fence);
+         slot.fence = nullptr;
+         slot.state = State::Encoding;
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&slot);
+         }
+         jobsCv.notify_one();
+      }
+   }
+
+   // Waits for the readbacks still in flight and encodes them, so the last
+   // frames before capture stops are written too. Render thread, context
+   // current; blocks until the files are written.
+   void flush() {
+      for (Slot& slot : slots) {
+         if (slot.state.load() == State::InFlight) glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFlushTimeoutNs);
+      }
+      poll();
+      waitIdle();
+      for (Slot& slot : slots) {
+         if (slot.state.load() == State::InFlight) std::cerr << "FrameCapture: readback timed out, dropped " << slot.path << std::endl;
+      }
+   }
+
+   uint64_t capturedFrames() const { return queued; }
+   uint64_t skippedFrames() const { return skipped; }
+
+private:
+   enum class State { Free, InFlight, Encoding };
+
+   static constexpr GLuint64 kFlushTimeoutNs = 1000000000;
+
+   struct Slot {
+      GLuint pbo = 0;
+      const uint8_t* mapped = nullptr;
+      GLsync fence = nullptr;
+      std::string path;
+      std::atomic<State> state{State::Free};
+   };
+
+   Slot slots[kSlots];
+   int width = 0;
+   int height = 0;
+   Encoder encoder;
+   uint64_t queued = 0;
+   uint64_t skipped = 0;
+
+   std::deque<Slot*> jobs;
+   std::mutex mutex;
+   std::condition_variable jobsCv;
+   std::condition_variable idleCv;
+   std::thread worker;
+   bool stopping = false;
+
+   void workerLoop() {
+      for (;;) {
+         Slot* slot;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobsCv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) break;
+            slot = jobs.front();
+         }
+
+         encoder(slot->mapped, width, height, slot->path);
+
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.pop_front();
+            slot->state = State::Free;
+         }
+         idleCv.notify_all();
+      }
+   }
+
+   void waitIdle() {
+      std::unique_lock<std::mutex> lock(mutex);
+      idleCv.wait(lock, [this] { return jobs.empty(); });
+   }
+
+   void release() {
+      for (Slot& slot : slots) {
+         if (slot.fence) glDeleteSync(slot.fence);
+         if (slot.pbo) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glDeleteBuffers(1, &slot.pbo);
+         }
+         slot.pbo = 0;
+         slot.mapped = nullptr;
+         slot.fence = nullptr;
+         slot.state = State::Free;
+      }
+   }
+
+   static void encodePng(const uint8_t* rgba, int w, int h, const std::string& path) {
+      QImage image(rgba, w, h, w * 4, QImage::Format_RGBA8888);
+      // GL rows start at the bottom
+      if (!image.mirrored().save(QString::fromStdString(path), "PNG")) {
+         std::cerr << "FrameCapture: failed to write " << path << std::endl;
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Ring buffer of the most recent frame times (milliseconds) with percentile
+// queries. Percentiles copy the window, so query them at most once per frame.
+class FrameStats {
+public:
+   static constexpr size_t kCapacity = 512;
+
+   void push(double ms) {
+      samples[head] = ms;
+      head = (head + 1) % kCapacity;
+      if (count < kCapacity) ++count;
+   }
+
+   size_t size() const { return count; }
+   double last() const { return count ? samples[(head + kCapacity - 1) % kCapacity] : 0.0; }
+
+   double average() const {
+      if (!count) return 0.0;
+      double sum = 0.0;
+      for (size_t i = 0; i < count; ++i) sum += samples[i];
+      return sum / double(count);
+   }
+
+   // p in [0, 1]
+   double percentile(double p) const {
+      if (!count) return 0.0;
+      scratch.assign(samples.begin(), samples.begin() + count);
+      size_t rank = std::min(count - 1, size_t(p * double(count - 1) + 0.5));
+      std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+      return scratch[rank];
+   }
+
+   double p50() const { return percentile(0.50); }
+   double p99() const { return percentile(0.99); }
+
+   void clear() { head = count = 0; }
+
+private:
+   std::array<double, kCapacity> samples{};
+   size_t head = 0;
+   size_t count = 0;
+   mutable std::vector<double> scratch;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Shadows the GL state the engine touches and drops calls that would not
+// change it. All binds on a context should go through one cache; after
+// anything else (Qt, a third-party library) touches the context, call
+// invalidate() so the next call of each kind is issued unconditionally.
+class GLStateCache {
+public:
+   struct Counters {
+      uint32_t issued = 0;
+      uint32_t skipped = 0;
+   };
+
+   GLStateCache() { invalidate(); }
+
+   void invalidate() {
+      program = kUnknown;
+      vertexArray = kUnknown;
+      for (auto& b : buffers) b = kUnknown;
+      activeUnit = kUnknown;
+      for (auto& t : textures) t = {kUnknown, kUnknown};
+      for (auto& c : caps) c = -1;
+      blendSrc = blendDst = kUnknown;
+      depthFunction = kUnknown;
+      depthWrite = -1;
+      drawFramebuffer = readFramebuffer = kUnknown;
+   }
+
+   // Starts a new counting window; the previous one stays readable via lastFrame().
+   void beginFrame() {
+      previous = current;
+      current = Counters();
+   }
+
+   const Counters& lastFrame() const { return previous; }
+   const Counters& thisFrame() const { return current; }
+
+   void useProgram(GLuint id) {
+      if (changed(program, id)) glUseProgram(id);
+   }
+
+   void bindVertexArray(GLuint id) {
+      if (!changed(vertexArray, id)) return;
+      glBindVertexArray(id);
+      // The element buffer binding belongs to the VAO.
+      buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = kUnknown;
+   }
+
+   void bindBuffer(GLenum target, GLuint id) {
+      int slot = bufferSlot(target);
+      if (slot < 0) {
+         ++current.issued;
+         glBindBuffer(target, id);
+         return;
+      }
+      if (changed(buffers[slot], id)) glBindBuffer(target, id);
+   }
+
+   // GL_FRAMEBUFFER sets both the draw and the read binding
+   void bindFramebuffer(GLenum target, GLuint id) {
+      bool draw = target != GL_READ_FRAMEBUFFER;
+      bool read = target != GL_DRAW_FRAMEBUFFER;
+      if ((!draw || drawFramebuffer == id) && (!read || readFramebuffer == id)) {
+         ++current.skipped;
+         return;
+      }
+      if (draw) drawFramebuffer = id;
+      if (read) readFramebuffer = id;
+      ++current.issued;
+      glBindFramebuffer(target, id);
+   }
+
+   void bindTexture(GLuint unit, GLenum target, GLuint id) {
+      if (unit >= kMaxTextureUnits) {
+         ++current.issued;
+         glActiveTexture(GL_TEXTURE0 + unit);
+         glBindTexture(target, id);
+         activeUnit = unit;
+         return;
+      }
+      Binding& slot = textures[unit];
+      if (slot.target == target && slot.id == id) {
+         ++current.skipped;
+         return;
+      }
+      if (activeUnit != unit) {
+         glActiveTexture(GL_TEXTURE0 + unit);
+         activeUnit = unit;
+         ++current.issued;
+      }
+      glBindTexture(target, id);
+      slot = {target, id};
+      ++current.issued;
+   }
+
+   void setEnabled(GLenum cap, bool enabled) {
+      int slot = capSlot(cap);
+      if (slot >= 0) {
+         if (caps[slot] == (enabled ? 1 : 0)) {
+            ++current.skipped;
+            return;
+         }
+         caps[slot] = enabled ? 1 : 0;
+      }
+      ++current.issued;
+      if (enabled) glEnable(cap); else glDisable(cap);
+   }
+
+   void blendFunc(GLenum src, GLenum dst) {
+      if (blendSrc == src && blendDst == dst) {
+         ++current.skipped;
+         return;
+      }
+      blendSrc = src;
+      blendDst = dst;
+      ++current.issued;
+      glBlendFunc(src, dst);
+   }
+
+   void depthFunc(GLenum func) {
+      if (changed(depthFunction, func)) glDepthFunc(func);
+   }
+
+   void depthMask(bool write) {
+      if (depthWrite == (write ? 1 : 0)) {
+         ++current.skipped;
+         return;
+      }
+      depthWrite = write ? 1 : 0;
+      ++current.issued;
+      glDepthMask(write ? GL_TRUE : GL_FALSE);
+   }
+
+   // Call after deleting objects so a recycled name is not mistaken for a bound one.
+   void forgetBuffer(GLuint id) {
+      for (auto& b : buffers) if (b == id) b = kUnknown;
+   }
+
+   void forgetTexture(GLuint id) {
+      for (auto& t : textures) if (t.id == id) t = {kUnknown, kUnknown};
+   }
+
+   void forgetFramebuffer(GLuint id) {
+      if (drawFramebuffer == id) drawFramebuffer = kUnknown;
+      if (readFramebuffer == id) readFramebuffer = kUnknown;
+   }
+
+   void forgetProgram(GLuint id) { if (program == id) program = kUnknown; }
+   void forgetVertexArray(GLuint id) { if (vertexArray == id) vertexArray = kUnknown; }
+
+private:
+   static constexpr GLuint kUnknown = 0xFFFFFFFFu;
+   static constexpr GLuint kMaxTextureUnits = 16;
+
+   struct Binding {
+      GLenum target;
+      GLuint id;
+   };
+
+   GLuint program;
+   GLuint vertexArray;
+   GLuint buffers[8];
+   GLuint activeUnit;
+   Binding textures[kMaxTextureUnits];
+   int caps[5];
+   GLenum blendSrc, blendDst;
+   GLenum depthFunction;
+   int depthWrite;
+   GLuint drawFramebuffer, readFramebuffer;
+
+   Counters current;
+   Counters previous;
+
+   bool changed(GLuint& cached, GLuint value) {
+      if (cached == value) {
+         ++current.skipped;
+         return false;
+      }
+      cached = value;
+      ++current.issued;
+      return true;
+   }
+
+   static int bufferSlot(GLenum target) {
+      switch (target) {
+         case GL_ARRAY_BUFFER: return 0;
+         case GL_ELEMENT_ARRAY_BUFFER: return 1;
+         case GL_UNIFORM_BUFFER: return 2;
+         case GL_SHADER_STORAGE_BUFFER: return 3;
+         case GL_DRAW_INDIRECT_BUFFER: return 4;
+         case GL_PIXEL_PACK_BUFFER: return 5;
+         case GL_PIXEL_UNPACK_BUFFER: return 6;
+         case GL_COPY_WRITE_BUFFER: return 7;
+         default: return -1;
+      }
+   }
+
+   static int capSlot(GLenum cap) {
+      switch (cap) {
+         case GL_BLEND: return 0;
+         case GL_DEPTH_TEST: return 1;
+         case GL_CULL_FACE: return 2;
+         case GL_SCISSOR_TEST: return 3;
+         case GL_STENCIL_TEST: return 4;
+         default: return -1;
+      }
+   }
+};
+
+#endif
@@ -1,14 +1,32 @@
+#ifndef GL_WIDGET_H
+#define GL_WIDGET_H
+
+#include <glad/glad.h>
+
 #include <QOpenGLWidget>
+#include <QOpenGLContext>
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
 
+#include <functional>
+#include <memory>
+
+#include "gl_state_cache.h"
+#include "gpu_profiler.h"
+#include "shared_gpu_resources.h"
+#include "text_renderer.h"
+
 class MyGLWidget : public QOpenGLWidget, protected QOpenGLFunctions {
 public:
    ~MyGLWidget() {
       // Cleanup OpenGL resources safely
       makeCurrent();
-      vbo.destroy();
+      if (vao) glDeleteVertexArrays(1, &vao);
+      if (vbo.isCreated()) vbo.destroy();
+      text.reset();
+      profiler.release();
+      shaders.reset();
       doneCurrent();
    }
 
@@ -17,11 +35,52 @@ public:
    void setVertexData(float* data, size_t size) {
       wasm_data_ptr = data;
       wasm_data_size = size;
+      vertexDataDirty = true;
+   }
+
+   // Draw from the buffer stored under key instead of uploading a private
+   // copy, when this widget's context shares with the GLFW one. Set before
+   // the widget is first shown.
+   void setSharedResources(SharedGpuResources* resources, const std::string& key) {
+      shared = resources;
+      sharedKey = key;
    }
 
+   // Draws text over the scene each paint: source is handed a renderer
+   // between begin() and flush() and adds this frame's strings. Fonts must
+   // use atlas, whose texture lives in the GLFW context, so text is only
+   // drawn when setSharedResources() got a share group this widget joins.
+   // Set before the widget is first shown.
+   void setTextSource(GlyphAtlas& atlas, std::function<void(TextRenderer&)> source) {
+      textAtlas = &atlas;
+      textSource = std::move(source);
+   }
+
+   bool usesSharedBuffer() const { return vertexBuffer && !vbo.isCreated(); }
+
+   // Glyphs drawn from the shared atlas in the last paint
+   size_t textGlyphsDrawn() const { return text ? text->lastDrawnGlyphs() : 0; }
+
+   // Issued vs. skipped state changes of the last painted frame
+   const GLStateCache::Counters& stateCounters() const { return state.lastFrame(); }
+
+   // Per-pass GPU timings, a couple of frames behind
+   const GpuProfiler& gpuTimings() const { return profiler; }
+
 protected:
    void initializeGL() override {
       initializeOpenGLFunctions();
+      // GLStateCache calls through glad. Its pointers are process-wide and
+      // NativeWindowManager normally loaded them already; loading them again
+      // from Qt's resolver would swap them under the GLFW context.
+      if (!GLVersion.major) {
+         gladLoadGLLoader([](const char* name) -> void* {
+            return reinterpret_cast<void*>(QOpenGLContext::currentContext()->getProcAddress(name));
+         });
+      }
+      state.invalidate();
+      profiler.init();
+
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
       // 1. Define Shaders
@@ -48,34 +107,87 @@ protected:
       program.addShaderFromSourceCode(QOpenGLShader::Fragment, fsrc);
       program.link();
 
-      vbo.create();
-      vbo.bind();
-      vbo.allocate(wasm_data_ptr, wasm_data_size);
-   }
-
-   void paintGL() override {
-      glClear(GL_COLOR_BUFFER_BIT);
+      if (shared && shared->visibleFrom(context())) {
+         // Already uploaded by the GLFW side; this just looks the name up
+         vertexBuffer = shared->buffer(state, sharedKey, GL_ARRAY_BUFFER, wasm_data_ptr, wasm_data_size, GL_DYNAMIC_DRAW);
+      } else {
+         vbo.create();
+         vbo.bind();
+         vbo.allocate(wasm_data_ptr, wasm_data_size);
+         vertexBuffer = vbo.bufferId();
+      }
+      vertexDataDirty = false;
 
-      program.bind();
-      vbo.bind();
+      // 3. Record the vertex layout once in a VAO instead of every frame.
+      // VAOs are never shared between contexts, even when the buffer is.
+      glGenVertexArrays(1, &vao);
+      state.bindVertexArray(vao);
+      state.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 
-      // Tell OpenGL how the data is structured (Attribute 0)
-      program.enableAttributeArray(0);
-      program.setAttributeBuffer(0, GL_FLOAT, 0, 3, 6 * sizeof(float));
+      // Attribute 0: Position (x, y, z)
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
 
       // Attribute 1: Color (r, g, b) - next 3 floats, offset by 3 floats
-      program.enableAttributeArray(1);
-      program.setAttributeBuffer(1, GL_FLOAT, 3 * sizeof(float), 3, 6 * sizeof(float));
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
 
-      glDrawArrays(GL_TRIANGLES, 0, 3);
+      if (textSource && shared && shared->visibleFrom(context())) {
+         shaders.reset(new ShaderCompiler());
+         text.reset(new TextRenderer());
+         text->init(*shaders, state, *textAtlas);
+      }
+   }
 
-      vbo.release();
-      program.release();
+   void paintGL() override {
+      // Qt binds its own framebuffer and may change any other state between
+      // paints
+      state.invalidate();
+      state.beginFrame();
+      profiler.beginFrame();
+      glClear(GL_COLOR_BUFFER_BIT);
+
+      if (vertexDataDirty) {
+         if (vbo.isCreated()) {
+            state.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(wasm_data_size), wasm_data_ptr);
+         } else {
+            shared->updateBuffer(state, sharedKey, wasm_data_ptr, wasm_data_size);
+         }
+         vertexDataDirty = false;
+      }
+
+      {
+         GpuScope scope(profiler, "triangle");
+         state.useProgram(program.programId());
+         state.bindVertexArray(vao);
+         glDrawArrays(GL_TRIANGLES, 0, 3);
+      }
+      if (text) {
+         GpuScope scope(profiler, "text");
+         text->begin();
+         textSource(*text);
+         text->flush(state);
+      }
+      profiler.endFrame();
    }
 
 private:
    QOpenGLShaderProgram program;
    QOpenGLBuffer vbo;
+   GLuint vertexBuffer = 0;
+   GLuint vao = 0;
+   SharedGpuResources* shared = nullptr;
+   std::string sharedKey;
+   GLStateCache state;
+   GpuProfiler profiler;
+   std::unique_ptr<ShaderCompiler> shaders;
+   std::unique_ptr<TextRenderer> text;
+   GlyphAtlas* textAtlas = nullptr;
+   std::function<void(TextRenderer&)> textSource;
    float* wasm_data_ptr = nullptr;
    size_t wasm_data_size = 0;
+   bool vertexDataDirty = false;
 };
+
+#endif
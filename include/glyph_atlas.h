@@ -0,0 +1,373 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state_cache.h"
+
+// Identifies one rasterization of a glyph. subpixel is the horizontal pen
+// offset the bitmap was rendered at, in 1/64 px, so entries stay valid
+// whatever bin count the font uses.
+struct GlyphKey {
+   uint32_t face = 0;
+   uint32_t codepoint = 0;
+   uint16_t pixelSize = 0;
+   uint8_t subpixel = 0;
+
+   bool operator==(const GlyphKey& o) const {
+      return face == o.face && codepoint == o.codepoint && pixelSize == o.pixelSize && subpixel == o.subpixel;
+   }
+};
+
+struct GlyphKeyHash {
+   size_t operator()(const GlyphKey& k) const {
+      uint64_t v = (uint64_t(k.face) << 40) ^ (uint64_t(k.pixelSize) << 24) ^ (uint64_t(k.subpixel) << 21) ^ k.codepoint;
+      v ^= v >> 33;
+      v *= 0xff51afd7ed558ccdULL;
+      v ^= v >> 33;
+      return size_t(v);
+   }
+};
+
+// A cached glyph: where its bitmap sits in the atlas plus the metrics
+// needed to place it. Atlas coordinates change when the atlas repacks; check
+// GlyphAtlas::generation() before reusing uvs from an earlier frame.
+struct Glyph {
+   int x = 0, y = 0;          // atlas pixels, top-left
+   int width = 0, height = 0;
+   int bearingX = 0, bearingY = 0;
+   float advance = 0.0f;      // pixels
+   float u0 = 0, v0 = 0, u1 = 0, v1 = 0;
+   uint64_t lastUsed = 0;
+   bool stale = false;        // bitmap lost in a repack; a miss until inserted again
+};
+
+// Bottom-left skyline bin packer: the free space is the region above a
+// piecewise-constant "skyline", and each rectangle goes where it ends up
+// lowest, ties broken by the narrower gap.
+class SkylinePacker {
+public:
+   SkylinePacker(int width = 0, int height = 0) { reset(width, height); }
+
+   void reset(int w, int h) {
+      width = w;
+      height = h;
+      skyline.assign(1, {0, 0, w});
+      used = 0;
+   }
+
+   bool insert(int w, int h, int& outX, int& outY) {
+      int bestIndex = -1, bestY = height, bestWidth = width + 1;
+      for (size_t i = 0; i < skyline.size(); ++i) {
+         int y;
+         if (!fits(i, w, h, y)) continue;
+         if (y < bestY || (y == bestY && skyline[i].width < bestWidth)) {
+            bestIndex = int(i);
+            bestY = y;
+            bestWidth = skyline[i].width;
+         }
+      }
+      if (bestIndex < 0) return false;
+
+      outX = skyline[size_t(bestIndex)].x;
+      outY = bestY;
+      place(size_t(bestIndex), outX, outY + h, w);
+      used += size_t(w) * size_t(h);
+      return true;
+   }
+
+   // Fraction of the area handed out so far
+   float occupancy() const { return width && height ? float(used) / (float(width) * float(height)) : 0.0f; }
+
+private:
+   struct Segment {
+      int x, y, width;
+   };
+
+   std::vector<Segment> skyline;
+   int width = 0;
+   int height = 0;
+   size_t used = 0;
+
+   bool fits(size_t index, int w, int h, int& y) const {
+      int x = skyline[index].x;
+      if (x + w > width) return false;
+      int remaining = w;
+      y = 0;
+      for (size_t i = index; remaining > 0; ++i) {
+         if (i == skyline.size()) return false;
+         y = std::max(y, skyline[i].y);
+         if (y + h > height) return false;
+         remaining -= skyline[i].width;
+      }
+      return true;
+   }
+
+   void place(size_t index, int x, int top, int w) {
+      skyline.insert(skyline.begin() + std::ptrdiff_t(index), {x, top, w});
+      // Trim the segments now covered by the new one
+      for (size_t i = index + 1; i < skyline.size();) {
+         Segment& s = skyline[i];
+         int end = x + w;
+         if (s.x >= end) break;
+         int shrink = end - s.x;
+         if (shrink >= s.width) {
+            skyline.erase(skyline.begin() + std::ptrdiff_t(i));
+            continue;
+         }
+         s.x += shrink;
+         s.width -= shrink;
+         break;
+      }
+      // Merge neighbours at the same height
+      for (size_t i = 0; i + 1 < skyline.size();) {
+         if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + std::ptrdiff_t(i + 1));
+         } else {
+            ++i;
+         }
+      }
+   }
+};
+
+// Single-channel glyph atlas. Bitmaps are packed with a skyline packer into
+// a CPU copy; upload() sends only the rectangle touched since the last upload
+// to the GL texture. When a glyph no longer fits, the least recently used
+// glyphs (never ones used in the current frame) are evicted and the rest are
+// repacked, which bumps generation().
+class GlyphAtlas {
+public:
+   struct Stats {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      uint64_t repacks = 0;
+      uint64_t uploadedBytes = 0;
+   };
+
+   static constexpr int kPadding = 1;
+
+   GlyphAtlas(int width = 1024, int height = 1024)
+   : width(width), height(height), pixels(size_t(width) * height, 0), packer(width, height) {}
+
+   ~GlyphAtlas() {
+      if (texture) glDeleteTextures(1, &texture);
+   }
+
+   GlyphAtlas(const GlyphAtlas&) = delete;
+   GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+   // Marks the start of a frame for LRU purposes
+   void beginFrame() { ++frame; }
+
+   // The cached glyph, or null. Counts as a use.
+   const Glyph* find(const GlyphKey& key) {
+      auto it = glyphs.find(key);
+      if (it == glyphs.end() || it->second.stale) {
+         ++stats.misses;
+         return nullptr;
+      }
+      ++stats.hits;
+      it->second.lastUsed = frame;
+      return &it->second;
+   }
+
+   // Whether key is cached, without counting a use
+   bool contains(const GlyphKey& key) const {
+      auto it = glyphs.find(key);
+      return it != glyphs.end() && !it->second.stale;
+   }
+
+   // Copies an 8-bit coverage bitmap in. metrics supplies bearings and
+   // advance; its position fields are filled in here. Returns null only if
+   // the glyph doesn't fit even after evicting everything not used this
+   // frame.
+   const Glyph* insert(const GlyphKey& key, const uint8_t* bitmap, int w, int h, int pitch, const Glyph& metrics) {
+      int x = 0, y = 0;
+      if (!allocate(w, h, x, y)) {
+         // Free a quarter first; if fragmentation still leaves no gap, drop
+         // everything that this frame doesn't need
+         evictAndRepack(w, h, 0.25f);
+         if (!allocate(w, h, x, y)) {
+            evictAndRepack(w, h, 1.0f);
+            if (!allocate(w, h, x, y)) return nullptr;
+         }
+      }
+
+      Glyph& glyph = glyphs[key];
+      glyph = metrics;
+      glyph.x = x;
+      glyph.y = y;
+      glyph.width = w;
+      glyph.height = h;
+      glyph.lastUsed = frame;
+      updateUv(glyph);
+
+      for (int row = 0; row < h; ++row) std::memcpy(&pixels[size_t(y + row) * width + x], bitmap + std::ptrdiff_t(row) * pitch, size_t(w));
+      markDirty(x, y, x + w, y + h);
+      return &glyph;
+   }
+
+   // Creates the texture on first use, then uploads the dirty rectangle. Needs a
+   // current GL context; texture unit 0 is left bound to the atlas.
+   GLuint upload(GLStateCache& state) {
+      if (!texture) {
+         glGenTextures(1, &texture);
+         state.bindTexture(0, GL_TEXTURE_2D, texture);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+         glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+         markDirty(0, 0, width, height);
+      }
+      if (dirty.x1 > dirty.x0 && dirty.y1 > dirty.y0) {
+         int w = dirty.x1 - dirty.x0, h = dirty.y1 - dirty.y0;
+         state.bindTexture(0, GL_TEXTURE_2D, texture);
+         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+         glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+         glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.x0, dirty.y0, w, h, GL_RED, GL_UNSIGNED_BYTE,
+                         &pixels[size_t(dirty.y0) * width + dirty.x0]);
+         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+         glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+         stats.uploadedBytes += uint64_t(w) * uint64_t(h);
+         dirty = {width, height, 0, 0};
+      }
+      return texture;
+   }
+
+   // Calls fn(key, glyph) for every cached glyph; pixels are in data()
+   template<typename Fn>
+   void forEach(Fn fn) const {
+      for (const auto& entry : glyphs) {
+         if (!entry.second.stale) fn(entry.first, entry.second);
+      }
+   }
+
+   GLuint getTexture() const { return texture; }
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+   const uint8_t* data() const { return pixels.data(); }
+   size_t size() const { return glyphs.size(); }
+   uint64_t generation() const { return repackGeneration; }
+   float occupancy() const { return packer.occupancy(); }
+   const Stats& getStats() const { return stats; }
+
+   // Drops every glyph, e.g. after the font set changes
+   void clear() {
+      glyphs.clear();
+      packer.reset(width, height);
+      std::fill(pixels.begin(), pixels.end(), uint8_t(0));
+      markDirty(0, 0, width, height);
+      ++repackGeneration;
+   }
+
+private:
+   int width;
+   int height;
+   std::vector<uint8_t> pixels;
+   SkylinePacker packer;
+   std::unordered_map<GlyphKey, Glyph, GlyphKeyHash> glyphs;
+   GLuint texture = 0;
+   uint64_t frame = 1;
+   uint64_t repackGeneration = 0;
+   struct Rect {
+      int x0, y0, x1, y1;
+   };
+   Rect dirty = {0, 0, 0, 0};
+   Stats stats;
+
+   // Bitmaps get kPadding empty pixels right and below so bilinear taps
+   // never bleed into a neighbour
+   bool allocate(int w, int h, int& x, int& y) {
+      return packer.insert(w + kPadding, h + kPadding, x, y);
+   }
+
+   void updateUv(Glyph& g) const {
+      g.u0 = float(g.x) / float(width);
+      g.v0 = float(g.y) / float(height);
+      g.u1 = float(g.x + g.width) / float(width);
+      g.v1 = float(g.y + g.height) / float(height);
+   }
+
+   void markDirty(int x0, int y0, int x1, int y1) {
+      if (dirty.x1 <= dirty.x0 || dirty.y1 <= dirty.y0) {
+         dirty = {x0, y0, x1, y1};
+         return;
+      }
+      dirty = {std::min(dirty.x0, x0), std::min(dirty.y0, y0), std::max(dirty.x1, x1), std::max(dirty.y1, y1)};
+   }
+
+   // Evicts glyphs oldest first until freeFraction of the atlas (or the
+   // incoming glyph, if larger) is free, then packs the survivors into a
+   // fresh skyline, tallest first.
+   void evictAndRepack(int w, int h, float freeFraction) {
+      std::vector<std::pair<GlyphKey, Glyph*>> entries;
+      entries.reserve(glyphs.size());
+      for (auto& entry : glyphs) entries.push_back({entry.first, &entry.second});
+      std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.second->lastUsed < b.second->lastUsed; });
+
+      size_t total = size_t(width) * height;
+      size_t wanted = std::max(size_t(double(total) * freeFraction), size_t(w + kPadding) * size_t(h + kPadding));
+      size_t live = 0;
+      for (const auto& entry : entries) live += size_t(entry.second->width + kPadding) * size_t(entry.second->height + kPadding);
+
+      std::vector<GlyphKey> evicted;
+      for (const auto& entry : entries) {
+         if (total - live >= wanted || entry.second->lastUsed == frame) break;
+         live -= size_t(entry.second->width + kPadding) * size_t(entry.second->height + kPadding);
+         evicted.push_back(entry.first);
+      }
+      for (const GlyphKey& key : evicted) glyphs.erase(key);
+      stats.evictions += evicted.size();
+
+      std::vector<std::pair<GlyphKey, Glyph*>> survivors;
+      survivors.reserve(glyphs.size());
+      for (auto& entry : glyphs) survivors.push_back({entry.first, &entry.second});
+      std::sort(survivors.begin(), survivors.end(), [](const auto& a, const auto& b) { return a.second->height > b.second->height; });
+
+      std::vector<uint8_t> old(pixels);
+      std::fill(pixels.begin(), pixels.end(), uint8_t(0));
+      packer.reset(width, height);
+      for (auto& survivor : survivors) {
+         Glyph* g = survivor.second;
+         int x = 0, y = 0;
+         // Survivors took no more room than before, but a different order
+         // can still strand one. Drop it; one already handed out this frame
+         // must stay put, so it is emptied and marked stale instead. It draws
+         // nothing this frame, and from the next one find() misses on it
+         // and it is rasterized and inserted again.
+         if (!allocate(g->width, g->height, x, y)) {
+            if (g->lastUsed == frame) {
+               g->width = g->height = 0;
+               g->stale = true;
+               updateUv(*g);
+            } else {
+               glyphs.erase(survivor.first);
+               ++stats.evictions;
+            }
+            continue;
+         }
+         for (int row = 0; row < g->height; ++row) {
+            std::memcpy(&pixels[size_t(y + row) * width + x], &old[size_t(g->y + row) * width + g->x], size_t(g->width));
+         }
+         g->x = x;
+         g->y = y;
+         updateUv(*g);
+      }
+
+      markDirty(0, 0, width, height);
+      ++stats.repacks;
+      ++repackGeneration;
+   }
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "font_engine.h"
+#include "font_registry.h"
+#include "glyph_atlas.h"
+
+// Persists a font's rasterized glyphs between runs. save() writes every
+// glyph the font has in its atlas (bitmaps and distance fields) together
+// with their metrics; load() maps the file and inserts the bitmaps straight
+// from the mapping into the atlas, so a warm start never touches FreeType.
+//
+// Files are named by a hash of the font bytes, the pixel size and the
+// render settings (subpixel bins, SDF size and spread), so editing the font
+// or changing a setting simply misses. The layout is native-endian; the
+// cache is meant for the machine that wrote it.
+class GlyphCache {
+public:
+   explicit GlyphCache(std::string directory = ".glyph_cache") : directory(std::move(directory)) {}
+
+   // Where font's cache lives; empty if the font file can't be mapped
+   std::string pathFor(const FontEngine& font) const {
+      uint64_t hash = fontHash(font);
+      if (!hash) return std::string();
+      char name[96];
+      std::snprintf(name, sizeof(name), "%016llx_%dpx_b%d_sdf%ds%d.glyphs", (unsigned long long)hash,
+                    font.getPixelSize(), font.getSubpixelBins(), FontEngine::kSdfSize, FontEngine::kSdfSpread);
+      return (std::filesystem::path(directory) / name).string();
+   }
+
+   // Restores font's glyphs from its cache file. Returns how many were
+   // inserted; 0 when there is no usable cache.
+   size_t load(FontEngine& font) {
+      std::string path = pathFor(font);
+      if (path.empty() || !std::filesystem::exists(path)) return 0;
+      std::shared_ptr<const MappedFont> file = MappedFont::open(path);
+      if (!file || file->size() < sizeof(Header)) return 0;
+
+      Header header;
+      std::memcpy(&header, file->data(), sizeof(header));
+      if (std::memcmp(header.magic, kMagic, sizeof(header.magic)) != 0 || header.version != kVersion) return 0;
+      size_t recordsEnd = sizeof(Header) + size_t(header.glyphCount) * sizeof(Record);
+      if (file->size() < recordsEnd || file->size() - recordsEnd < header.pixelBytes) return 0;
+
+      const uint8_t* pixels = file->data() + recordsEnd;
+      GlyphAtlas& atlas = font.getAtlas();
+      size_t restored = 0;
+      for (uint32_t i = 0; i < header.glyphCount; ++i) {
+         Record r;
+         std::memcpy(&r, file->data() + sizeof(Header) + size_t(i) * sizeof(Record), sizeof(r));
+         if (r.width < 0 || r.height < 0 || r.offset + uint64_t(r.width) * uint64_t(r.height) > header.pixelBytes) {
+            std::cerr << "Glyph cache " << path << " is corrupt" << std::endl;
+            break;
+         }
+
+         GlyphKey key;
+         key.face = font.getFaceId();
+         key.codepoint = r.codepoint;
+         key.pixelSize = r.pixelSize;
+         key.subpixel = r.subpixel;
+         if (atlas.contains(key)) continue;
+
+         Glyph metrics;
+         metrics.bearingX = r.bearingX;
+         metrics.bearingY = r.bearingY;
+         metrics.advance = r.advance;
+         if (!atlas.insert(key, pixels + r.offset, r.width, r.height, r.width, metrics)) break;
+         ++restored;
+      }
+      return restored;
+   }
+
+   // Writes every glyph font has in its atlas. Replaces the file atomically.
+   bool save(FontEngine& font) {
+      std::string path = pathFor(font);
+      if (path.empty()) return false;
+
+      const GlyphAtlas& atlas = font.getAtlas();
+      std::vector<Record> records;
+      std::vector<uint8_t> pixels;
+      atlas.forEach([&](const GlyphKey& key, const Glyph& g) {
+         if (key.face != font.getFaceId()) return;
+         Record r;
+         r.codepoint = key.codepoint;
+         r.pixelSize = key.pixelSize;
+         r.subpixel = key.subpixel;
+         r.width = g.width;
+         r.height = g.height;
+         r.bearingX = g.bearingX;
+         r.bearingY = g.bearingY;
+         r.advance = g.advance;
+         r.offset = pixels.size();
+         for (int row = 0; row < g.height; ++row) {
+            const uint8_t* src = atlas.data() + size_t(g.y + row) * size_t(atlas.getWidth()) + size_t(g.x);
+            pixels.insert(pixels.end(), src, src + g.width);
+         }
+         records.push_back(r);
+      });
+      // load() inserts in file order; tallest first packs best
+      std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.height > b.height; });
+
+      Header header;
+      std::memcpy(header.magic, kMagic, sizeof(header.magic));
+      header.version = kVersion;
+      header.glyphCount = uint32_t(records.size());
+      header.pixelBytes = pixels.size();
+
+      std::error_code error;
+      std::filesystem::create_directories(directory, error);
+      std::string temp = path + ".tmp";
+      {
+         std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+         if (!out) {
+            std::cerr << "Could not write glyph cache " << temp << std::endl;
+            return false;
+         }
+         out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+         out.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(Record)));
+         out.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(pixels.size()));
+         if (!out) return false;
+      }
+      std::filesystem::rename(temp, path, error);
+      return !error;
+   }
+
+private:
+   static constexpr char kMagic[4] = {'E', 'G', 'C', 'A'};
+   static constexpr uint32_t kVersion = 2;
+
+   struct Header {
+      char magic[4];
+      uint32_t version;
+      uint32_t glyphCount;
+      uint32_t reserved = 0;
+      uint64_t pixelBytes;
+   };
+
+   struct Record {
+      uint32_t codepoint;
+      uint16_t pixelSize;
+      uint8_t subpixel;
+      uint8_t reserved = 0;
+      int32_t width, height;
+      int32_t bearingX, bearingY;
+      float advance;
+      uint64_t offset; // into the pixel block
+   };
+
+   std::string directory;
+
+   // FNV-1a over the font file; 0 if it can't be mapped
+   static uint64_t fontHash(const FontEngine& font) {
+      std::shared_ptr<const MappedFont> file = MappedFont::open(font.getFontPath());
+      if (!file) return 0;
+      uint64_t hash = 14695981039346656037ull;
+      const uint8_t* p = file->data();
+      for (size_t i = 0; i < file->size(); ++i) {
+         hash ^= p[i];
+         hash *= 1099511628211ull;
+      }
+      return hash;
+   }
+};
+
+#endif
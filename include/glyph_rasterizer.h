@@ -0,0 +1,192 @@
+#ifndef GLYPH_RASTERIZER_H
+#define GLYPH_RASTERIZER_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "font_engine.h"
+#include "font_registry.h"
+#include "glyph_atlas.h"
+#include "job_system.h"
+#include "sdf_generator.h"
+
+// Rasterizes a FontEngine's glyphs on worker threads. FreeType faces are not
+// thread-safe, so each worker has its own FontRegistry (FT_Library, face and
+// sizes) over the process-wide mapping of the font file. Requests are queued from any thread; finished bitmaps wait
+// in an outbox until the atlas owner calls publish(), which never waits on a
+// worker.
+//
+// Constructing one makes the font hand its atlas misses here (glyph() returns
+// null until publish() delivers). Destroy it before the FontEngine.
+class GlyphRasterizer {
+public:
+   struct Stats {
+      std::atomic<uint64_t> requested{0};
+      std::atomic<uint64_t> rasterized{0};
+      std::atomic<uint64_t> failed{0};
+      std::atomic<uint64_t> published{0};
+   };
+
+   // 0 = one worker per hardware thread besides the caller
+   explicit GlyphRasterizer(FontEngine& font, unsigned workers = 0) : font(font) {
+      if (workers == 0) {
+         unsigned hw = std::thread::hardware_concurrency();
+         workers = hw > 1 ? hw - 1 : 1;
+      }
+      for (unsigned i = 0; i < workers; ++i) threads.emplace_back(&GlyphRasterizer::workerLoop, this);
+      font.setMissHandler([this](const GlyphKey& key) { request(key); });
+   }
+
+   ~GlyphRasterizer() {
+      font.setMissHandler(nullptr);
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         stopping = true;
+      }
+      queueCv.notify_all();
+      for (auto& t : threads) t.join();
+   }
+
+   GlyphRasterizer(const GlyphRasterizer&) = delete;
+   GlyphRasterizer& operator=(const GlyphRasterizer&) = delete;
+
+   // Queues a glyph unless it is already queued, waiting to be published or
+   // known to fail
+   void request(const GlyphKey& key) {
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         if (failedKeys.count(key) || !pending.insert(key).second) return;
+         queue.push_back(key);
+      }
+      stats.requested.fetch_add(1);
+      queueCv.notify_one();
+   }
+
+   // Queues [first, last] at the font's size in every subpixel bin, or as
+   // distance fields
+   void requestRange(uint32_t first, uint32_t last, bool sdf = false) {
+      GlyphKey key;
+      key.face = font.getFaceId();
+      key.pixelSize = uint16_t(sdf ? FontEngine::kSdfSize : font.getPixelSize());
+      const int bins = sdf ? 1 : font.getSubpixelBins();
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         for (int bin = 0; bin < bins; ++bin) {
+            key.subpixel = sdf ? FontEngine::kSdfBin : font.subpixelOffset(uint8_t(bin));
+            for (uint32_t c = first; c <= last; ++c) {
+               key.codepoint = c;
+               if (failedKeys.count(key) || !pending.insert(key).second) continue;
+               queue.push_back(key);
+               stats.requested.fetch_add(1);
+            }
+         }
+      }
+      queueCv.notify_all();
+   }
+
+   // Moves up to maxGlyphs finished glyphs into atlas. Call from the thread
+   // that owns the atlas, e.g. once per frame before drawing text. Returns 0
+   // straight away if a worker holds the lock.
+   size_t publish(GlyphAtlas& atlas, size_t maxGlyphs = SIZE_MAX) {
+      std::vector<Result> ready;
+      {
+         std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+         if (!lock.owns_lock() || outbox.empty()) return 0;
+         size_t n = std::min(maxGlyphs, outbox.size());
+         ready.assign(std::make_move_iterator(outbox.begin()), std::make_move_iterator(outbox.begin() + std::ptrdiff_t(n)));
+         outbox.erase(outbox.begin(), outbox.begin() + std::ptrdiff_t(n));
+         for (const Result& r : ready) pending.erase(r.key);
+      }
+
+      size_t published = 0;
+      for (Result& r : ready) {
+         if (atlas.contains(r.key)) continue;
+         const FontEngine::Raster& g = r.raster;
+         if (atlas.insert(r.key, g.pixels.data(), g.width, g.height, g.width, g.metrics)) {
+            ++published;
+         } else {
+            qCritical() << "Glyph atlas full, dropped glyph:" << r.key.codepoint;
+         }
+      }
+      stats.published.fetch_add(published);
+      return published;
+   }
+
+   // Requests not yet published
+   size_t outstanding() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return pending.size();
+   }
+
+   unsigned workerCount() const { return unsigned(threads.size()); }
+   const Stats& getStats() const { return stats; }
+
+private:
+   struct Result {
+      GlyphKey key;
+      FontEngine::Raster raster;
+   };
+
+   FontEngine& font;
+   std::vector<std::thread> threads;
+   mutable std::mutex mutex;
+   std::condition_variable queueCv;
+   std::deque<GlyphKey> queue;
+   std::unordered_set<GlyphKey, GlyphKeyHash> pending; // queued, in flight or in outbox
+   std::vector<Result> outbox;
+   std::unordered_set<GlyphKey, GlyphKeyHash> failedKeys;
+   bool stopping = false;
+   Stats stats;
+
+   void workerLoop() {
+      FontRegistry fonts;
+      // Without a face the worker still drains the queue, failing every key,
+      // so outstanding() reaches zero and the keys are not requested again
+      FT_Face face = fonts.face(font.getFontPath());
+      // Distance fields split rows over the shared pool as usual
+      SdfGenerator sdf(JobSystem::shared(), FontEngine::kSdfSpread);
+
+      for (;;) {
+         GlyphKey key;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) break;
+            key = queue.front();
+            queue.pop_front();
+         }
+
+         Result result;
+         result.key = key;
+         bool ok = face && FontEngine::rasterize(fonts, face, sdf, key, result.raster);
+         if (ok) stats.rasterized.fetch_add(1);
+         else stats.failed.fetch_add(1);
+
+         std::lock_guard<std::mutex> lock(mutex);
+         if (ok) {
+            outbox.push_back(std::move(result));
+         } else {
+            pending.erase(key);
+            failedKeys.insert(key);
+            if (face) qCritical() << "Failed to load Glyph:" << key.codepoint;
+         }
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Measures GPU time per frame and per named pass without ever waiting on the
+// GPU. Scopes are bracketed by GL_TIMESTAMP queries, so they may nest; the
+// whole frame is a GL_TIME_ELAPSED query. Query sets are double-buffered: a
+// set is only read back when the frame that used it comes round again, and
+// only if the driver reports the results available; otherwise that frame's
+// numbers are dropped rather than stalling.
+class GpuProfiler {
+public:
+   struct Timing {
+      std::string name;
+      int depth;
+      double ms;
+   };
+
+   static constexpr int kQuerySets = 2;
+
+   ~GpuProfiler() { release(); }
+
+   // Deletes the queries; needs the context current. Everything below is a
+   // no-op afterwards until init() runs again.
+   void release() {
+      for (auto& set : sets) {
+         if (!set.queries.empty()) glDeleteQueries(GLsizei(set.queries.size()), set.queries.data());
+         if (set.frameQuery) glDeleteQueries(1, &set.frameQuery);
+         set = QuerySet();
+      }
+      enabled = false;
+      current = nullptr;
+   }
+
+   // Needs timer queries (core since GL 3.3). Returns false, and every call
+   // below becomes a no-op, when the context lacks them.
+   bool init() {
+      enabled = glQueryCounter != nullptr && glGetQueryObjectui64v != nullptr;
+      if (!enabled) return false;
+      for (auto& set : sets) glGenQueries(1, &set.frameQuery);
+      return true;
+   }
+
+   void beginFrame() {
+      if (!enabled) return;
+      current = &sets[frameIndex % kQuerySets];
+      if (current->pending) collect(*current);
+      current->scopes.clear();
+      current->used = 0;
+      depth = 0;
+      glBeginQuery(GL_TIME_ELAPSED, current->frameQuery);
+   }
+
+   void endFrame() {
+      if (!enabled || !current) return;
+      glEndQuery(GL_TIME_ELAPSED);
+      current->pending = true;
+      current = nullptr;
+      ++frameIndex;
+   }
+
+   void beginScope(const char* name) {
+      if (!enabled || !current) return;
+      Scope scope;
+      scope.name = name;
+      scope.depth = depth++;
+      scope.begin = nextQuery(*current);
+      scope.end = 0;
+      glQueryCounter(current->queries[scope.begin], GL_TIMESTAMP);
+      current->scopes.push_back(scope);
+   }
+
+   void endScope() {
+      if (!enabled || !current) return;
+      --depth;
+      // Close the innermost scope still open
+      for (auto it = current->scopes.rbegin(); it != current->scopes.rend(); ++it) {
+         if (it->end == 0) {
+            it->end = nextQuery(*current);
+            glQueryCounter(current->queries[it->end], GL_TIMESTAMP);
+            return;
+         }
+      }
+   }
+
+   // Most recent frame whose results have arrived (two frames behind)
+   const std::vector<Timing>& passTimings() const { return latest; }
+   double frameMs() const { return latestFrameMs; }
+   uint64_t droppedFrames() const { return dropped; }
+
+   // One line per pass, indented by nesting; suitable for an on-screen overlay
+   std::string summary() const {
+      std::ostringstream out;
+      out.setf(std::ios::fixed);
+      out.precision(3);
+      out << "GPU " << latestFrameMs << " ms\n";
+      for (const auto& t : latest) out << std::string(size_t(t.depth + 1) * 2, ' ') << t.name << ' ' << t.ms << " ms\n";
+      return out.str();
+   }
+
+   // "name:ms|name:ms" for one CSV column next to the CPU timings
+   std::string csvPasses() const {
+      std::ostringstream out;
+      for (size_t i = 0; i < latest.size(); ++i) {
+         if (i) out << '|';
+         out << latest[i].name << ':' << latest[i].ms;
+      }
+      return out.str();
+   }
+
+private:
+   struct Scope {
+      std::string name;
+      int depth;
+      size_t begin;
+      size_t end;
+   };
+
+   struct QuerySet {
+      std::vector<GLuint> queries;
+      size_t used = 0;
+      std::vector<Scope> scopes;
+      GLuint frameQuery = 0;
+      bool pending = false;
+   };
+
+   QuerySet sets[kQuerySets];
+   QuerySet* current = nullptr;
+   uint64_t frameIndex = 0;
+   int depth = 0;
+   bool enabled = false;
+
+   std::vector<Timing> latest;
+   double latestFrameMs = 0.0;
+   uint64_t dropped = 0;
+
+   static size_t nextQuery(QuerySet& set) {
+      if (set.used == set.queries.size()) {
+         size_t grow = set.queries.empty() ? 32 : set.queries.size();
+         set.queries.resize(set.queries.size() + grow);
+         glGenQueries(GLsizei(grow), set.queries.data() + set.queries.size() - grow);
+      }
+      return set.used++;
+   }
+
+   static bool available(GLuint query) {
+      GLuint ready = GL_FALSE;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &ready);
+      return ready == GL_TRUE;
+   }
+
+   void collect(QuerySet& set) {
+      set.pending = false;
+      if (!available(set.frameQuery)) {
+         ++dropped;
+         return;
+      }
+      for (const Scope& s : set.scopes) {
+         if (s.end == 0 || !available(set.queries[s.end])) {
+            ++dropped;
+            return;
+         }
+      }
+
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(set.frameQuery, GL_QUERY_RESULT, &elapsed);
+      latestFrameMs = double(elapsed) / 1e6;
+
+      latest.clear();
+      for (const Scope& s : set.scopes) {
+         GLuint64 t0 = 0, t1 = 0;
+         glGetQueryObjectui64v(set.queries[s.begin], GL_QUERY_RESULT, &t0);
+         glGetQueryObjectui64v(set.queries[s.end], GL_QUERY_RESULT, &t1);
+         latest.push_back({s.name, s.depth, double(t1 - t0) / 1e6});
+      }
+   }
+};
+
+// Times the enclosing block on the GPU:  GpuScope scope(profiler, "shadows");
+class GpuScope {
+public:
+   GpuScope(GpuProfiler& profiler, const char* name) : profiler(profiler) { profiler.beginScope(name); }
+   ~GpuScope() { profiler.endScope(); }
+
+   GpuScope(const GpuScope&) = delete;
+   GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+   GpuProfiler& profiler;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef INSTANCE_RENDERER_H
+#define INSTANCE_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "gl_state_cache.h"
+#include "render_queue.h"
+#include "shader_compiler.h"
+
+// One instance as written by the WASM guest (see Instance in main.zig).
+struct InstanceData {
+   float transform[16]; // column-major
+   float color[4];
+};
+
+// Draws many copies of one mesh with a single instanced draw call. Per-instance
+// transforms and colors live in their own buffer, filled straight from WASM
+// linear memory each frame; the mesh buffers are never touched again.
+class InstanceRenderer {
+public:
+   ~InstanceRenderer() {
+      if (vao) glDeleteVertexArrays(1, &vao);
+      if (instanceVbo) glDeleteBuffers(1, &instanceVbo);
+   }
+
+   // meshVbo holds interleaved position/color vertices (6 floats) like the
+   // WASM triangle. Pass an element buffer to draw indexed.
+   bool init(ShaderCompiler& compiler, GLStateCache& state, GLuint meshVbo, GLsizei vertexCount,
+             GLuint meshIbo = 0, GLsizei indexCount = 0) {
+      this->compiler = &compiler;
+      this->vertexCount = vertexCount;
+      this->indexCount = indexCount;
+      shader = compiler.submitSource("instanced", vertexSource, fragmentSource);
+
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &instanceVbo);
+      state.bindVertexArray(vao);
+
+      state.bindBuffer(GL_ARRAY_BUFFER, meshVbo);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+      if (meshIbo) state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIbo);
+
+      // Attributes 2-5: transform columns, 6: color; advance once per instance
+      state.bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+      for (GLuint column = 0; column < 4; ++column) {
+         glEnableVertexAttribArray(2 + column);
+         glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                               (void*)(offsetof(InstanceData, transform) + column * 4 * sizeof(float)));
+         glVertexAttribDivisor(2 + column, 1);
+      }
+      glEnableVertexAttribArray(6);
+      glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+      glVertexAttribDivisor(6, 1);
+
+      state.bindVertexArray(0);
+      return true;
+   }
+
+   // Switches to a program built from files instead of the embedded sources,
+   // so that it can be hot reloaded. Keeps the embedded one when the files
+   // are missing or don't link.
+   bool loadShader(const std::string& vertexPath, const std::string& fragmentPath) {
+      ShaderCompiler::Handle handle = compiler->submit(vertexPath, fragmentPath);
+      if (!compiler->program(handle)) {
+         std::cerr << "InstanceRenderer: keeping the built-in shader, " << vertexPath << " + " << fragmentPath
+                   << " did not load" << std::endl;
+         return false;
+      }
+      shader = handle;
+      return true;
+   }
+
+   ShaderCompiler::Handle shaderHandle() const { return shader; }
+
+   // Copies instances from guest memory. The pointer comes from
+   // WasmManager::get_memory_ptr and must be re-fetched every frame since
+   // memory.grow can move linear memory.
+   void upload(GLStateCache& state, const InstanceData* data, size_t count) {
+      instanceCount = count;
+      state.bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+      GLsizeiptr bytes = GLsizeiptr(count * sizeof(InstanceData));
+      if (size_t(bytes) > capacity) {
+         capacity = size_t(bytes);
+         glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+      } else {
+         // Orphan so the driver does not wait for last frame's draw
+         glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(capacity), NULL, GL_STREAM_DRAW);
+         glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+      }
+   }
+
+   void draw(GLStateCache& state) {
+      GLuint id = program();
+      if (!id || instanceCount == 0) return;
+      state.useProgram(id);
+      state.bindVertexArray(vao);
+      if (indexCount) {
+         glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0, GLsizei(instanceCount));
+      } else {
+         glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, GLsizei(instanceCount));
+      }
+   }
+
+   // Same draw, recorded into a command buffer instead of issued directly.
+   void record(CommandBuffer& commands, uint64_t key) {
+      GLuint id = program();
+      if (!id || instanceCount == 0) return;
+      if (indexCount) {
+         commands.drawElements(key, id, vao, GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, 0, GLsizei(instanceCount));
+      } else {
+         commands.drawArrays(key, id, vao, GL_TRIANGLES, 0, vertexCount, GLsizei(instanceCount));
+      }
+   }
+
+   size_t count() const { return instanceCount; }
+
+   // Attribute layout: 0 position, 1 color, 2-5 instance transform, 6 instance
+   // color. shaders/instanced.vert and .frag hold the same program.
+   static constexpr const char* vertexSource =
+      "#version 440 core\n"
+      "layout (location = 0) in vec3 aPos;\n"
+      "layout (location = 1) in vec3 aColor;\n"
+      "layout (location = 2) in mat4 iTransform;\n"
+      "layout (location = 6) in vec4 iColor;\n"
+      "out vec3 ourColor;\n"
+      "void main() {\n"
+      "   gl_Position = iTransform * vec4(aPos, 1.0);\n"
+      "   ourColor = aColor * iColor.rgb;\n"
+      "}\n";
+
+   static constexpr const char* fragmentSource =
+      "#version 440 core\n"
+      "out vec4 FragColor;\n"
+      "in vec3 ourColor;\n"
+      "void main() {\n"
+      "   FragColor = vec4(ourColor, 1.0);\n"
+      "}\n";
+
+private:
+   ShaderCompiler* compiler = nullptr;
+   ShaderCompiler::Handle shader = 0;
+   GLuint vao = 0;
+   GLuint instanceVbo = 0;
+   size_t capacity = 0;
+   size_t instanceCount = 0;
+   GLsizei vertexCount = 0;
+   GLsizei indexCount = 0;
+
+   GLuint program() { return compiler ? compiler->program(shader) : 0; }
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads for data-parallel CPU work. parallelFor()
+// cuts a range into chunks that workers and the calling thread pull from a
+// shared counter until none are left, then returns; several threads may call
+// it at once.
+class JobSystem {
+public:
+   using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+   // 0 = one worker per hardware thread besides the caller
+   explicit JobSystem(unsigned workers = 0) {
+      if (workers == 0) {
+         unsigned hw = std::thread::hardware_concurrency();
+         workers = hw > 1 ? hw - 1 : 1;
+      }
+      for (unsigned i = 0; i < workers; ++i) threads.emplace_back(&JobSystem::workerLoop, this);
+   }
+
+   ~JobSystem() {
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         stopping = true;
+      }
+      workCv.notify_all();
+      for (auto& t : threads) t.join();
+   }
+
+   JobSystem(const JobSystem&) = delete;
+   JobSystem& operator=(const JobSystem&) = delete;
+
+   // Calls fn on [begin, end) chunks of at most grain items covering
+   // [0, count). Blocks until every chunk has run.
+   void parallelFor(size_t count, size_t grain, const RangeFn& fn) {
+      if (count == 0) return;
+      grain = std::max<size_t>(grain, 1);
+      Batch batch(fn, count, grain);
+      if (batch.chunks == 1) {
+         fn(0, count);
+         return;
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         batches.push_back(&batch);
+      }
+      workCv.notify_all();
+
+      runChunks(batch);
+
+      std::unique_lock<std::mutex> lock(mutex);
+      auto it = std::find(batches.begin(), batches.end(), &batch);
+      if (it != batches.end()) batches.erase(it);
+      doneCv.wait(lock, [&batch] { return batch.users == 0 && batch.finished.load() == batch.chunks; });
+   }
+
+   unsigned workerCount() const { return unsigned(threads.size()); }
+
+   // Process-wide pool for code that has no natural owner for one
+   static JobSystem& shared() {
+      static JobSystem pool;
+      return pool;
+   }
+
+private:
+   struct Batch {
+      Batch(const RangeFn& fn, size_t count, size_t grain)
+      : fn(fn), count(count), grain(grain), chunks((count + grain - 1) / grain) {}
+
+      const RangeFn& fn;
+      size_t count;
+      size_t grain;
+      size_t chunks;
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> finished{0};
+      int users = 0; // workers inside runChunks(); guarded by the pool mutex
+   };
+
+   std::vector<std::thread> threads;
+   std::deque<Batch*> batches;
+   std::mutex mutex;
+   std::condition_variable workCv;
+   std::condition_variable doneCv;
+   bool stopping = false;
+
+   static void runChunks(Batch& batch) {
+      size_t chunk;
+      while ((chunk = batch.next.fetch_add(1)) < batch.chunks) {
+         size_t begin = chunk * batch.grain;
+         batch.fn(begin, std::min(batch.count, begin + batch.grain));
+         batch.finished.fetch_add(1);
+      }
+   }
+
+   void workerLoop() {
+      for (;;) {
+         Batch* batch;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            workCv.wait(lock, [this] { return stopping || !batches.empty(); });
+            if (stopping) return;
+            batch = batches.front();
+            // Drained batches stay queued until their caller removes them;
+            // don't spin on them
+            if (batch->next.load() >= batch->chunks) {
+               batches.pop_front();
+               continue;
+            }
+            ++batch->users;
+         }
+
+         runChunks(*batch);
+
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            --batch->users;
+         }
+         doneCv.notify_all();
+      }
+   }
+};
+
+#endif
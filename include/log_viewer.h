@@ -0,0 +1,267 @@
+#ifndef LOG_VIEWER_H
+#define LOG_VIEWER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "database_manager.h"
+#include "font_engine.h"
+#include "text_layout.h"
+#include "text_renderer.h"
+
+// Scrollable overlay over DatabaseManager's logs table. Only a page of rows
+// around the visible window is ever held: update() pages through the table by
+// id as the view scrolls, so moving anywhere in millions of rows costs a few
+// primary-key seeks. draw() lays out just the rows on screen through a
+// TextLayout, so rows that stay on screen aren't laid out again.
+//
+// update() queries the database and must run on the thread that opened it;
+// draw() must run on the GL thread. window() is everything draw() needs, so
+// with a render thread it travels in the frame packet.
+class LogViewer {
+public:
+   // The rows on screen, top first, with one extra row below when there
+   // is one; how far (in rows) the view is scrolled past the top one; and
+   // how many rows the panel holds
+   struct Window {
+      std::vector<std::string> lines;
+      float offset = 0.0f;
+      size_t rows = 0;
+   };
+
+   struct Stats {
+      uint64_t queries = 0;
+      uint64_t rowsFetched = 0;
+   };
+
+   explicit LogViewer(DatabaseManager& db, int visibleRows = 40, int pageRows = 512)
+   : db(db), visibleRows(std::max(1, visibleRows)), pageRows(std::max(pageRows, 4 * std::max(1, visibleRows))) {}
+
+   void setVisibleRows(int rows) {
+      visibleRows = std::max(1, rows);
+      pageRows = std::max(pageRows, 4 * visibleRows);
+      dirty = true;
+   }
+
+   // Scrolls by rows, positive towards newer ones. The view eases there
+   // over the next few update() calls.
+   void scroll(double rows) {
+      if (rows == 0.0) return;
+      target += rows;
+      if (rows < 0.0) following = false;
+   }
+
+   // Shows the newest rows and keeps up with new ones as they are logged.
+   // This is where a new viewer starts.
+   void scrollToEnd() {
+      following = true;
+      jumpId = INT64_MAX;
+   }
+
+   // Puts the row with id, or the first one after it, at the top
+   void scrollToId(int64_t id) {
+      following = false;
+      jumpId = id;
+   }
+
+   // Advances the scroll animation, polls for new rows and pages rows in
+   // as the view moves. Returns true when window() changed.
+   bool update(double dt) {
+      bool changed = false;
+      pollTimer -= dt;
+      if (pollTimer <= 0.0) {
+         pollTimer = kPollInterval;
+         changed |= refresh();
+      }
+      if (!hasRows) return changed;
+
+      // A jump too far to page towards goes straight to the ids it lands on;
+      // ids are nearly dense, so the row index maps to an id directly
+      const double reach = double(pageRows) / 2.0;
+      if (rows.empty() && jumpId == 0) jumpId = INT64_MAX;
+      // Logging outran the page while following: catch up in one step
+      if (jumpId == 0 && following && lastId - rows.back().id > pageRows) jumpId = INT64_MAX;
+      if (jumpId == 0 && target < -reach) jumpId = std::max(firstId, rows.front().id + int64_t(target));
+      if (jumpId == 0 && target > double(rows.size()) + reach) jumpId = std::min(lastId, rows.back().id + int64_t(target - double(rows.size())));
+      if (jumpId != 0) {
+         int64_t id = jumpId;
+         jumpId = 0;
+         if (id == INT64_MAX) {
+            loadPage(lastId + 1, pageRows);
+            position = target = tailPosition();
+         } else {
+            loadPage(id, pageRows / 2);
+            position = target = double(rowsBefore);
+         }
+         changed = dirty = true;
+      }
+      if (rows.empty()) return changed;
+
+      // Stop at the ends of the table; reaching the newest row resumes
+      // following
+      if (rows.front().id <= firstId) target = std::max(target, 0.0);
+      if (rows.back().id >= lastId) {
+         if (target >= tailPosition()) following = true;
+         target = std::min(target, tailPosition());
+      }
+      if (following) target = tailPosition();
+
+      double step = target - position;
+      if (step != 0.0) {
+         position = std::abs(step) < 0.01 ? target : position + step * (1.0 - std::exp(-kEasing * dt));
+         changed = true;
+      }
+
+      // Keep a margin of loaded rows on both sides of the window
+      const double top = std::floor(position);
+      const double margin = double(visibleRows);
+      if ((top < margin && rows.front().id > firstId) || (top + 2.0 * margin > double(rows.size()) && rows.back().id < lastId)) {
+         size_t anchor = size_t(std::min(std::max(top, 0.0), double(rows.size() - 1)));
+         loadPage(rows[anchor].id, pageRows / 2);
+         double shift = double(rowsBefore) - double(anchor);
+         position += shift;
+         target += shift;
+         dirty = true;
+      }
+
+      return buildWindow() || changed;
+   }
+
+   const Window& window() const { return view; }
+
+   // Queues the rows of w with the top of the panel at (x, y), in
+   // distance-field glyphs at size. The rows scrolled partly out at the top
+   // and bottom fade rather than being clipped.
+   void draw(TextRenderer& text, FontEngine& font, const Window& w, float x, float y, float size, uint32_t color = 0xFFFFFFFFu) {
+      FT_Face face = font.getFace();
+      if (!face) return;
+      layout.beginFrame();
+      const float lineHeight = font.lineHeight(size);
+      const float descent = -float(face->descender) * size / float(face->units_per_EM);
+      const float alpha = float(color >> 24);
+      for (size_t i = 0; i < w.lines.size(); ++i) {
+         float baseline = y + (float(i) + 1.0f - w.offset) * lineHeight - descent;
+         uint32_t rowColor = color;
+         if (i == 0) rowColor = (color & 0x00FFFFFFu) | uint32_t(alpha * (1.0f - w.offset)) << 24;
+         if (i == w.rows) rowColor = (color & 0x00FFFFFFu) | uint32_t(alpha * w.offset) << 24;
+         if (rowColor >> 24 == 0) continue;
+         text.addParagraph(font, layout.layout(font, w.lines[i], 0.0f, size), x, baseline, rowColor);
+      }
+   }
+
+   bool isFollowing() const { return following; }
+   const Stats& getStats() const { return stats; }
+
+private:
+   // New rows are looked for this often, in seconds
+   static constexpr double kPollInterval = 0.25;
+   // How quickly the view catches up with the scroll target, per second
+   static constexpr double kEasing = 18.0;
+   // Longer messages are cut to this many bytes on screen
+   static constexpr size_t kMaxLineBytes = 240;
+
+   DatabaseManager& db;
+   int visibleRows;
+   int pageRows;
+   std::vector<DatabaseManager::LogRow> rows; // loaded page, messages formatted
+   size_t rowsBefore = 0;                     // rows loadPage() put before its anchor
+   int64_t firstId = 0, lastId = 0;
+   int64_t jumpId = INT64_MAX;                // 0 = none, INT64_MAX = tail
+   double position = 0.0, target = 0.0;       // top row, as an index into rows
+   double pollTimer = 0.0;
+   bool hasRows = false; // the table, not just the page
+   bool following = true;
+   bool dirty = true;
+   size_t windowTop = SIZE_MAX;
+   Window view;
+   TextLayout layout; // draw() only
+   Stats stats;
+
+   double tailPosition() const { return double(std::max<size_t>(rows.size(), size_t(visibleRows)) - size_t(visibleRows)); }
+
+   // Re-reads the id range and appends rows logged since, if the page
+   // reaches the old end. Returns true when rows were added or dropped.
+   bool refresh() {
+      int64_t first, last;
+      ++stats.queries;
+      hasRows = db.logIdRange(first, last);
+      if (!hasRows) {
+         bool hadRows = !rows.empty();
+         rows.clear();
+         view = Window();
+         windowTop = SIZE_MAX;
+         return hadRows;
+      }
+      bool atEnd = !rows.empty() && rows.back().id >= lastId;
+      firstId = first;
+      lastId = last;
+      if (rows.empty() || !atEnd || last <= rows.back().id) return false;
+
+      std::vector<DatabaseManager::LogRow> fresh = fetch(rows.back().id + 1, pageRows, false);
+      rows.insert(rows.end(), fresh.begin(), fresh.end());
+      // Drop the oldest rows once the page has grown to twice its size
+      if (rows.size() > size_t(2 * pageRows)) {
+         size_t drop = std::min(rows.size() - size_t(pageRows), size_t(std::max(0.0, std::floor(position) - double(visibleRows))));
+         rows.erase(rows.begin(), rows.begin() + std::ptrdiff_t(drop));
+         position -= double(drop);
+         target -= double(drop);
+      }
+      dirty = true;
+      return true;
+   }
+
+   // Loads a page of rows: up to `before` rows older than anchorId, then
+   // rows from anchorId on, pageRows in all
+   void loadPage(int64_t anchorId, int before) {
+      std::vector<DatabaseManager::LogRow> older = fetch(anchorId, before, true);
+      std::vector<DatabaseManager::LogRow> newer = fetch(anchorId, pageRows - int(older.size()), false);
+      rowsBefore = older.size();
+      rows = std::move(older);
+      rows.insert(rows.end(), newer.begin(), newer.end());
+   }
+
+   std::vector<DatabaseManager::LogRow> fetch(int64_t fromId, int limit, bool backward) {
+      if (limit <= 0) return {};
+      std::vector<DatabaseManager::LogRow> page = db.fetchLogs(fromId, limit, backward);
+      ++stats.queries;
+      stats.rowsFetched += page.size();
+      for (DatabaseManager::LogRow& row : page) row.message = format(row);
+      return page;
+   }
+
+   // "#id  message" on one line, cut at a UTF-8 boundary
+   static std::string format(const DatabaseManager::LogRow& row) {
+      std::string line = "#" + std::to_string(row.id) + "  ";
+      size_t length = row.message.size();
+      if (length > kMaxLineBytes) {
+         length = kMaxLineBytes;
+         while (length > 0 && (uint8_t(row.message[length]) & 0xC0) == 0x80) --length;
+      }
+      line.append(row.message, 0, length);
+      std::replace(line.begin(), line.end(), '\n', ' ');
+      if (length < row.message.size()) line += "...";
+      return line;
+   }
+
+   // Refreshes the visible lines when the top row or the page changed
+   bool buildWindow() {
+      size_t top = rows.empty() ? 0 : size_t(std::min(std::max(std::floor(position), 0.0), double(rows.size() - 1)));
+      float offset = rows.empty() ? 0.0f : float(std::max(0.0, position - double(top)));
+      bool changed = offset != view.offset;
+      view.offset = offset;
+      if (!dirty && top == windowTop) return changed;
+
+      dirty = false;
+      windowTop = top;
+      view.rows = size_t(visibleRows);
+      size_t end = std::min(rows.size(), top + size_t(visibleRows) + 1);
+      view.lines.clear();
+      for (size_t i = top; i < end; ++i) view.lines.push_back(rows[i].message);
+      return true;
+   }
+};
+
+#endif
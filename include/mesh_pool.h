@@ -0,0 +1,214 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "gl_state_cache.h"
+#include "instance_renderer.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER. A
+// GPU culling pass can later write the same records from a compute shader.
+struct DrawElementsIndirectCommand {
+   GLuint count;
+   GLuint instanceCount;
+   GLuint firstIndex;
+   GLint baseVertex;
+   GLuint baseInstance;
+};
+
+struct MeshHandle {
+   uint32_t firstVertex = 0;
+   uint32_t vertexCount = 0;
+   uint32_t firstIndex = 0;
+   uint32_t indexCount = 0;
+};
+
+// First-fit allocator over [0, capacity) with coalescing on release.
+class RangeAllocator {
+public:
+   explicit RangeAllocator(uint32_t capacity = 0) { reset(capacity); }
+
+   void reset(uint32_t capacity) {
+      freeRanges.clear();
+      if (capacity) freeRanges[0] = capacity;
+   }
+
+   bool allocate(uint32_t size, uint32_t& offset) {
+      for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+         if (it->second < size) continue;
+         offset = it->first;
+         uint32_t remaining = it->second - size;
+         freeRanges.erase(it);
+         if (remaining) freeRanges[offset + size] = remaining;
+         return true;
+      }
+      return false;
+   }
+
+   void release(uint32_t offset, uint32_t size) {
+      if (!size) return;
+      auto next = freeRanges.lower_bound(offset);
+      if (next != freeRanges.end() && offset + size == next->first) {
+         size += next->second;
+         next = freeRanges.erase(next);
+      }
+      if (next != freeRanges.begin()) {
+         auto prev = std::prev(next);
+         if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+         }
+      }
+      freeRanges[offset] = size;
+   }
+
+private:
+   std::map<uint32_t, uint32_t> freeRanges; // offset -> size
+};
+
+// Packs static meshes into one shared vertex buffer and one shared index
+// buffer so that any number of them can be drawn with a single
+// glMultiDrawElementsIndirect. Vertices use the 6-float position/color layout
+// of the WASM triangle. Each queued draw carries an InstanceData record reached
+// through baseInstance, so InstanceRenderer::vertexSource works as-is.
+class MeshPool {
+public:
+   ~MeshPool() {
+      if (!vao) return;
+      glDeleteVertexArrays(1, &vao);
+      GLuint buffers[] = {vertexBuffer, indexBuffer, perDrawBuffer, indirectBuffer};
+      glDeleteBuffers(4, buffers);
+   }
+
+   // Storage is immutable (glBufferStorage, GL 4.4), so capacities are fixed.
+   bool init(GLStateCache& state, uint32_t maxVertices, uint32_t maxIndices) {
+      vertexAllocator.reset(maxVertices);
+      indexAllocator.reset(maxIndices);
+
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &vertexBuffer);
+      glGenBuffers(1, &indexBuffer);
+      glGenBuffers(1, &perDrawBuffer);
+      glGenBuffers(1, &indirectBuffer);
+
+      state.bindVertexArray(vao);
+
+      state.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+      glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(maxVertices) * kVertexStride, NULL, GL_DYNAMIC_STORAGE_BIT);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kVertexStride, (void*)0);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, kVertexStride, (void*)(3 * sizeof(float)));
+
+      state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+      glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(maxIndices) * sizeof(uint32_t), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+      state.bindBuffer(GL_ARRAY_BUFFER, perDrawBuffer);
+      for (GLuint column = 0; column < 4; ++column) {
+         glEnableVertexAttribArray(2 + column);
+         glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                               (void*)(offsetof(InstanceData, transform) + column * 4 * sizeof(float)));
+         glVertexAttribDivisor(2 + column, 1);
+      }
+      glEnableVertexAttribArray(6);
+      glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+      glVertexAttribDivisor(6, 1);
+
+      state.bindVertexArray(0);
+      return true;
+   }
+
+   // Copies a mesh into the shared buffers. Indices are relative to the mesh's
+   // own vertices; baseVertex takes care of the offset at draw time.
+   bool add(GLStateCache& state, const float* vertices, uint32_t vertexCount,
+            const uint32_t* indices, uint32_t indexCount, MeshHandle& out) {
+      uint32_t firstVertex, firstIndex;
+      if (!vertexAllocator.allocate(vertexCount, firstVertex)) {
+         std::cerr << "MeshPool: out of vertex space for " << vertexCount << " vertices" << std::endl;
+         return false;
+      }
+      if (!indexAllocator.allocate(indexCount, firstIndex)) {
+         vertexAllocator.release(firstVertex, vertexCount);
+         std::cerr << "MeshPool: out of index space for " << indexCount << " indices" << std::endl;
+         return false;
+      }
+
+      state.bindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(firstVertex) * kVertexStride,
+                      GLsizeiptr(vertexCount) * kVertexStride, vertices);
+      state.bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(firstIndex) * sizeof(uint32_t),
+                      GLsizeiptr(indexCount) * sizeof(uint32_t), indices);
+
+      out = {firstVertex, vertexCount, firstIndex, indexCount};
+      return true;
+   }
+
+   void remove(const MeshHandle& mesh) {
+      vertexAllocator.release(mesh.firstVertex, mesh.vertexCount);
+      indexAllocator.release(mesh.firstIndex, mesh.indexCount);
+   }
+
+   // Queues one draw of a mesh for the next drawQueued().
+   void queue(const MeshHandle& mesh, const InstanceData& perDraw) {
+      DrawElementsIndirectCommand cmd;
+      cmd.count = mesh.indexCount;
+      cmd.instanceCount = 1;
+      cmd.firstIndex = mesh.firstIndex;
+      cmd.baseVertex = GLint(mesh.firstVertex);
+      cmd.baseInstance = GLuint(perDrawData.size());
+      commands.push_back(cmd);
+      perDrawData.push_back(perDraw);
+   }
+
+   // Uploads the CPU-built command list and issues every queued draw with one
+   // glMultiDrawElementsIndirect. Returns the number of draws collapsed.
+   size_t drawQueued(GLStateCache& state, GLuint program) {
+      size_t drawCount = commands.size();
+      if (drawCount == 0 || !program) {
+         clearQueue();
+         return 0;
+      }
+
+      state.bindBuffer(GL_ARRAY_BUFFER, perDrawBuffer);
+      glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(perDrawData.size() * sizeof(InstanceData)), perDrawData.data(), GL_STREAM_DRAW);
+      state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(drawCount * sizeof(DrawElementsIndirectCommand)), commands.data(), GL_STREAM_DRAW);
+
+      state.useProgram(program);
+      state.bindVertexArray(vao);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, GLsizei(drawCount), 0);
+
+      clearQueue();
+      return drawCount;
+   }
+
+   GLuint vertexArray() const { return vao; }
+
+private:
+   static constexpr GLsizei kVertexStride = 6 * sizeof(float);
+
+   RangeAllocator vertexAllocator;
+   RangeAllocator indexAllocator;
+   GLuint vao = 0;
+   GLuint vertexBuffer = 0;
+   GLuint indexBuffer = 0;
+   GLuint perDrawBuffer = 0;
+   GLuint indirectBuffer = 0;
+
+   std::vector<DrawElementsIndirectCommand> commands;
+   std::vector<InstanceData> perDrawData;
+
+   void clearQueue() {
+      commands.clear();
+      perDrawData.clear();
+   }
+};
+
+#endif
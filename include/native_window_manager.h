@@ -4,17 +4,71 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#ifdef ENIGMA_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "damage_tracker.h"
+#include "frame_capture.h"
+#include "frame_stats.h"
+#include "gl_state_cache.h"
+#include "gpu_profiler.h"
+#include "render_target.h"
+
 class NativeWindowManager {
 public:
-   NativeWindowManager(unsigned int width, unsigned int height, const char* title)
-   : width(width), height(height), title(title), window(nullptr) {}
+   // Frame pacing for run(). The simulation always advances in fixed steps;
+   // rendering gets the leftover fraction of a step to interpolate with.
+   struct LoopConfig {
+      int swapInterval;        // 0 disables vsync
+      double maxFps;           // 0 leaves the rate to vsync alone
+      double fixedTimestep;    // seconds per simulation step
+      int maxStepsPerFrame;    // drop time instead of spiralling after a stall
+      bool onDemand;           // only repaint damaged regions, sleep otherwise
+      double idleTimeout;      // on demand: longest sleep before update() runs again
 
+      static LoopConfig interactive() { return {1, 0.0, 1.0 / 60.0, 5, false, 0.0}; }
+      // Default for the overlay window: it sits on top of other apps, so keep
+      // GPU and compositor load down.
+      static LoopConfig lowPower() { return {1, 30.0, 1.0 / 60.0, 5, true, 0.25}; }
+   };
+
+   // Headless renders into an offscreen target through an EGL surfaceless
+   // context (Mesa llvmpipe works), so no display server is needed.
+   enum class Backend { Window, Headless };
+
+   NativeWindowManager(unsigned int width, unsigned int height, const char* title,
+                       Backend backend = Backend::Window)
+   : width(width), height(height), title(title), window(nullptr), backend(backend) {}
+
+   // Anything else holding GL objects of this context must be destroyed
+   // first; once the context is gone their destructors have nothing to call.
    ~NativeWindowManager() {
+      releaseGpuObjects();
+      if (backend == Backend::Headless) {
+         destroyHeadless();
+         return;
+      }
+      for (GLFWwindow* shared : sharedContexts) glfwDestroyWindow(shared);
       if (window) glfwDestroyWindow(window);
       glfwTerminate();
    }
 
    bool init() {
+      if (backend == Backend::Headless) return initHeadless();
       if (!glfwInit()) return false;
 
       // Configure OpenGL version and profile
@@ -44,21 +98,458 @@ public:
          return false;
       }
 
-      glEnable(GL_DEPTH_TEST);
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      glfwSwapInterval(loopConfig.swapInterval);
+      gpuProfiler.init();
+      installCallbacks();
+
+      int fbWidth, fbHeight;
+      glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+      onResize(fbWidth, fbHeight);
+      applyPendingResize();
+
+      stateCache.setEnabled(GL_DEPTH_TEST, true);
+      stateCache.setEnabled(GL_BLEND, true);
+      stateCache.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
       return true;
    }
 
    GLFWwindow* getWindow() const { return window; }
-   bool shouldClose() const { return glfwWindowShouldClose(window); }
-   void swapBuffers() { glfwSwapBuffers(window); glfwPollEvents(); }
+   bool isHeadless() const { return backend == Backend::Headless; }
+
+   bool shouldClose() const {
+      if (backend == Backend::Headless) return framesRendered >= headlessFrameLimit;
+      return glfwWindowShouldClose(window);
+   }
+
+   void swapBuffers() {
+      present();
+      pollEvents();
+   }
+
+   // The two halves of swapBuffers(). present() may run on whichever thread
+   // owns the context; pollEvents() must stay on the main thread.
+   void present() {
+      if (backend == Backend::Headless) {
+         glFinish();
+         ++framesRendered;
+         return;
+      }
+      glfwSwapBuffers(window);
+   }
+
+   void pollEvents() {
+      if (window) glfwPollEvents();
+   }
+
+   // Moves the GL context between threads: release it on the old thread
+   // before making it current on the new one.
+   void makeContextCurrent() {
+      if (backend == Backend::Headless) {
+#ifdef ENIGMA_HAS_EGL
+         eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext);
+#endif
+         return;
+      }
+      glfwMakeContextCurrent(window);
+   }
+
+   void releaseContext() {
+      if (backend == Backend::Headless) {
+#ifdef ENIGMA_HAS_EGL
+         eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+         return;
+      }
+      glfwMakeContextCurrent(nullptr);
+   }
+
+   // Applies the latest framebuffer size from the resize callback (viewport
+   // and, on demand, the offscreen target). The callback runs on the main
+   // thread, which may not own the context, so this is called at the start
+   // of each frame by whichever thread does. A caller that draws straight to
+   // the window (RenderThread) passes toWindow: the target is then released
+   // rather than resized, and renderDamage() builds it again at the current
+   // size if run() ever draws on demand.
+   void applyPendingResize(bool toWindow = false) {
+      uint64_t size = pendingSize.exchange(0);
+      if (!size) return;
+      int fbWidth = int(size >> 32), fbHeight = int(size & 0xFFFFFFFFu);
+      glViewport(0, 0, fbWidth, fbHeight);
+      if (!loopConfig.onDemand) return;
+      if (toWindow) target.destroy(stateCache);
+      else target.resize(stateCache, fbWidth, fbHeight);
+   }
+
+   // Headless: number of frames run() renders before returning
+   void setHeadlessFrameLimit(unsigned long frames) { headlessFrameLimit = frames; }
+
+   // Headless: the framebuffer everything is drawn into
+   const RenderTarget& getRenderTarget() const { return target; }
+
+   // Saves every Nth frame as <prefix><frame>.png through async readback;
+   // nullptr disables. The capture object must outlive run(). Replacing one
+   // writes out its readbacks still in flight, so call it with the context
+   // current.
+   void setFrameCapture(FrameCapture* capture, unsigned long everyNFrames, const std::string& prefix) {
+      if (frameCapture && frameCapture != capture) frameCapture->flush();
+      frameCapture = capture;
+      captureEvery = everyNFrames ? everyNFrames : 1;
+      capturePrefix = prefix;
+   }
+
+   // Open GpuScopes on this inside render(); run() brackets each frame
+   GpuProfiler& getGpuProfiler() { return gpuProfiler; }
+
+   // The cache every bind on the window's context goes through, the
+   // manager's own (render target, scissor, captures) included
+   GLStateCache& getStateCache() { return stateCache; }
+
+   // Writes "frame,cpu_ms,total_ms,gpu_ms,gpu_passes" per rendered frame (GPU
+   // columns lag two frames behind); nullptr disables
+   void setFrameLog(std::ostream* log) { frameLog = log; }
+
+   void setLoopConfig(const LoopConfig& config) {
+      loopConfig = config;
+      if (window) glfwSwapInterval(config.swapInterval);
+   }
+   const LoopConfig& getLoopConfig() const { return loopConfig; }
+
+   // Frame times of run() from wake-up to the end of pacing. In on-demand mode
+   // only frames that were actually drawn are counted.
+   const FrameStats& getFrameStats() const { return frameStats; }
+
+   // Time spent in update() and render() alone, i.e. CPU-side submission
+   const FrameStats& getCpuFrameStats() const { return cpuFrameStats; }
+
+   // Process CPU time over wall time during the last run(), 1.0 = one core busy
+   double getCpuUsage() const { return cpuUsage; }
+
+   // On-demand mode: repaint everything / one region on the next frame. Keys,
+   // mouse buttons, the wheel and resizes request a full repaint on their
+   // own. Pointer motion doesn't, or every mouse move would repaint the
+   // overlay; a scene that reacts to hover damages what it changes.
+   void requestRedraw() {
+      damage.addFull();
+      if (window) glfwPostEmptyEvent();
+   }
+   void addDamage(const DamageRect& rect) {
+      damage.add(rect);
+      if (window) glfwPostEmptyEvent();
+   }
+
+   // Vertical mouse-wheel movement since the last call, in wheel steps
+   // (positive away from the user). Main thread only, like pollEvents().
+   double takeScroll() {
+      double steps = scrollY;
+      scrollY = 0.0;
+      return steps;
+   }
+
+   // Runs until the window is closed. update(dt) is called zero or more times
+   // per frame with the fixed timestep; render(alpha) once, with alpha in
+   // [0, 1) being how far the clock is past the last simulated step.
+   //
+   // In on-demand mode the loop blocks in glfwWaitEventsTimeout and render()
+   // only runs when something is damaged, once per damaged region with the
+   // scissor set, into a persistent offscreen target that is then presented.
+   // render() must not bind the default framebuffer in that mode.
+   //
+   // Headless runs exactly one fixed step per frame and finishes the GL work
+   // before the frame ends, so runs are reproducible and the frame time
+   // includes the GPU side.
+   void run(const std::function<void(double)>& update, const std::function<void(double)>& render) {
+      if (backend == Backend::Headless) {
+         runHeadless(update, render);
+         return;
+      }
+
+      using clock = std::chrono::steady_clock;
+      auto previous = clock::now();
+      auto wallStart = previous;
+      std::clock_t cpuStart = std::clock();
+      double accumulator = 0.0;
+      bool animating = true;
+
+      damage.addFull();
+      while (!shouldClose()) {
+         if (loopConfig.onDemand && damage.empty()) {
+            // While something animates, wake every step so update() can keep
+            // it going; once a step passes without damage, sleep longer.
+            glfwWaitEventsTimeout(animating ? loopConfig.fixedTimestep : loopConfig.idleTimeout);
+         } else {
+            glfwPollEvents();
+         }
+
+         applyPendingResize();
+         auto frameStart = clock::now();
+         accumulator += std::chrono::duration<double>(frameStart - previous).count();
+         previous = frameStart;
+
+         const double dt = loopConfig.fixedTimestep;
+         int steps = 0;
+         while (accumulator >= dt && steps < loopConfig.maxStepsPerFrame) {
+            update(dt);
+            accumulator -= dt;
+            ++steps;
+         }
+         accumulator = std::min(accumulator, dt);
+
+         if (loopConfig.onDemand) {
+            animating = !damage.empty();
+            if (!animating) continue;
+            gpuProfiler.beginFrame();
+            renderDamage(render, accumulator / dt);
+         } else {
+            gpuProfiler.beginFrame();
+            render(accumulator / dt);
+         }
+         gpuProfiler.endFrame();
+         if (loopConfig.onDemand) {
+            captureFrame(target.framebuffer(), target.getWidth(), target.getHeight());
+         } else {
+            int fbWidth, fbHeight;
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+            captureFrame(0, fbWidth, fbHeight);
+         }
+         double cpuMs = std::chrono::duration<double, std::milli>(clock::now() - frameStart).count();
+         glfwSwapBuffers(window);
+
+         if (loopConfig.maxFps > 0.0) {
+            waitUntil(frameStart + std::chrono::duration_cast<clock::duration>(
+               std::chrono::duration<double>(1.0 / loopConfig.maxFps)));
+         }
+
+         recordFrame(cpuMs, std::chrono::duration<double, std::milli>(clock::now() - frameStart).count());
+      }
+
+      double wall = std::chrono::duration<double>(clock::now() - wallStart).count();
+      double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+      cpuUsage = wall > 0.0 ? cpu / wall : 0.0;
+   }
+
+   // Hidden window whose context shares objects with the main one, meant to be
+   // made current on a worker thread (e.g. for background shader compiles).
+   // Must be called from the main thread; owned by this manager. Returns
+   // nullptr for the headless backend.
+   GLFWwindow* createSharedContext() {
+      if (backend == Backend::Headless) return nullptr;
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      GLFWwindow* shared = glfwCreateWindow(1, 1, title, NULL, window);
+      glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+      if (shared) sharedContexts.push_back(shared);
+      return shared;
+   }
 
 private:
    unsigned int width, height;
    const char* title;
    GLFWwindow* window;
+   Backend backend;
+   std::vector<GLFWwindow*> sharedContexts;
+   LoopConfig loopConfig = LoopConfig::lowPower();
+   FrameStats frameStats;
+   FrameStats cpuFrameStats;
+   GpuProfiler gpuProfiler;
+   GLStateCache stateCache;
+   FrameCapture* frameCapture = nullptr;
+   unsigned long captureEvery = 1;
+   std::string capturePrefix;
+   DamageTracker damage;
+   RenderTarget target;
+   double cpuUsage = 0.0;
+   double scrollY = 0.0;
+   std::ostream* frameLog = nullptr;
+   std::atomic<unsigned long> framesRendered{0};
+   std::atomic<uint64_t> pendingSize{0}; // width << 32 | height, 0 = none
+   unsigned long framesRecorded = 0;
+   unsigned long headlessFrameLimit = 600;
+
+#ifdef ENIGMA_HAS_EGL
+   EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+   EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+   // Our own GL objects go while the context still exists
+   void releaseGpuObjects() {
+      bool hasContext = window != nullptr;
+#ifdef ENIGMA_HAS_EGL
+      if (backend == Backend::Headless) hasContext = eglContext != EGL_NO_CONTEXT;
+#endif
+      if (!hasContext) return;
+      makeContextCurrent();
+      target.destroy(stateCache);
+      gpuProfiler.release();
+   }
+
+   bool initHeadless() {
+#ifdef ENIGMA_HAS_EGL
+      auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay) {
+         eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+      }
+      if (eglDisplay == EGL_NO_DISPLAY) eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+      if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, NULL, NULL)) {
+         std::cerr << "Headless: no EGL display" << std::endl;
+         return false;
+      }
+      if (!eglBindAPI(EGL_OPENGL_API)) {
+         std::cerr << "Headless: EGL has no desktop OpenGL" << std::endl;
+         return false;
+      }
+
+      const EGLint configAttribs[] = {
+         EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+         EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+         EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+         EGL_NONE
+      };
+      EGLConfig config;
+      EGLint numConfigs = 0;
+      if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+         std::cerr << "Headless: no matching EGL config" << std::endl;
+         return false;
+      }
+
+      // Same 4.4 core profile the window path asks GLFW for
+      const EGLint contextAttribs[] = {
+         EGL_CONTEXT_MAJOR_VERSION, 4,
+         EGL_CONTEXT_MINOR_VERSION, 4,
+         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+         EGL_NONE
+      };
+      eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+      if (eglContext == EGL_NO_CONTEXT ||
+          !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+         std::cerr << "Headless: could not create a surfaceless GL 4.4 context" << std::endl;
+         return false;
+      }
+
+      if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+         return false;
+      }
+
+      gpuProfiler.init();
+      damage.setSurface(width, height);
+      if (!target.resize(stateCache, width, height)) return false;
+      target.bind(stateCache);
+
+      stateCache.setEnabled(GL_DEPTH_TEST, true);
+      stateCache.setEnabled(GL_BLEND, true);
+      stateCache.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      return true;
+#else
+      std::cerr << "Headless: built without EGL support" << std::endl;
+      return false;
+#endif
+   }
+
+   void destroyHeadless() {
+#ifdef ENIGMA_HAS_EGL
+      if (eglDisplay == EGL_NO_DISPLAY) return;
+      eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+      eglTerminate(eglDisplay);
+#endif
+   }
+
+   void runHeadless(const std::function<void(double)>& update, const std::function<void(double)>& render) {
+      using clock = std::chrono::steady_clock;
+      auto wallStart = clock::now();
+      std::clock_t cpuStart = std::clock();
+
+      while (!shouldClose()) {
+         auto frameStart = clock::now();
+         target.bind(stateCache);
+         update(loopConfig.fixedTimestep);
+         gpuProfiler.beginFrame();
+         render(0.0);
+         gpuProfiler.endFrame();
+         captureFrame(target.framebuffer(), target.getWidth(), target.getHeight());
+         double cpuMs = std::chrono::duration<double, std::milli>(clock::now() - frameStart).count();
+
+         swapBuffers();
+         recordFrame(cpuMs, std::chrono::duration<double, std::milli>(clock::now() - frameStart).count());
+      }
+
+      double wall = std::chrono::duration<double>(clock::now() - wallStart).count();
+      double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+      cpuUsage = wall > 0.0 ? cpu / wall : 0.0;
+   }
+
+   void captureFrame(GLuint framebuffer, int w, int h) {
+      if (!frameCapture) return;
+      frameCapture->poll();
+      if (framesRecorded % captureEvery == 0 && frameCapture->init(w, h)) {
+         frameCapture->capture(stateCache, framebuffer, capturePrefix + std::to_string(framesRecorded) + ".png");
+      }
+   }
+
+   void recordFrame(double cpuMs, double totalMs) {
+      cpuFrameStats.push(cpuMs);
+      frameStats.push(totalMs);
+      ++framesRecorded;
+      if (frameLog) {
+         *frameLog << framesRecorded << ',' << cpuMs << ',' << totalMs << ','
+                   << gpuProfiler.frameMs() << ',' << gpuProfiler.csvPasses() << '\n';
+      }
+   }
+
+   static NativeWindowManager* fromWindow(GLFWwindow* w) {
+      return static_cast<NativeWindowManager*>(glfwGetWindowUserPointer(w));
+   }
+
+   void installCallbacks() {
+      glfwSetWindowUserPointer(window, this);
+      glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int fbWidth, int fbHeight) {
+         fromWindow(w)->onResize(fbWidth, fbHeight);
+      });
+      glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) { fromWindow(w)->damage.addFull(); });
+      glfwSetKeyCallback(window, [](GLFWwindow* w, int, int, int, int) { fromWindow(w)->damage.addFull(); });
+      glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int, int, int) { fromWindow(w)->damage.addFull(); });
+      glfwSetScrollCallback(window, [](GLFWwindow* w, double, double dy) {
+         fromWindow(w)->scrollY += dy;
+         fromWindow(w)->damage.addFull();
+      });
+   }
+
+   // No GL here: damage is main-thread state, the GL side waits for
+   // applyPendingResize()
+   void onResize(int fbWidth, int fbHeight) {
+      if (fbWidth <= 0 || fbHeight <= 0) return;
+      damage.setSurface(fbWidth, fbHeight);
+      pendingSize = uint64_t(uint32_t(fbWidth)) << 32 | uint32_t(fbHeight);
+   }
+
+   void renderDamage(const std::function<void(double)>& render, double alpha) {
+      if (!target.framebuffer()) {
+         int fbWidth, fbHeight;
+         glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+         target.resize(stateCache, fbWidth, fbHeight);
+         // Nothing of earlier frames survives in a new target
+         damage.addFull();
+      }
+
+      target.bind(stateCache);
+      stateCache.setEnabled(GL_SCISSOR_TEST, true);
+      for (const DamageRect& r : damage.regions()) {
+         glScissor(r.x, r.y, r.width, r.height);
+         render(alpha);
+      }
+      stateCache.setEnabled(GL_SCISSOR_TEST, false);
+      target.blitToDefault(stateCache);
+      damage.clear();
+   }
+
+   // Sleeps until shortly before the deadline, then spins the rest of the way;
+   // sleep alone overshoots by the scheduler's granularity.
+   static void waitUntil(std::chrono::steady_clock::time_point deadline) {
+      const auto spinWindow = std::chrono::microseconds(1500);
+      auto now = std::chrono::steady_clock::now();
+      if (deadline - now > spinWindow) std::this_thread::sleep_for(deadline - now - spinWindow);
+      while (std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+   }
 };
 
 #endif
@@ -0,0 +1,379 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "job_system.h"
+#include "scene_graph.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_CULLER_SSE 1
+#endif
+
+// Software occlusion culling, CPU only. A handful of occluder meshes are
+// rasterized into a small depth buffer, four pixels at a time, with the
+// screen split into horizontal bands that run as parallel jobs. A max-depth
+// pyramid is then built over it, and an object is occluded when the nearest
+// point of its projected bounds lies behind the farthest occluder depth over
+// the pixels it covers. Needs no GL context, so it also runs on headless,
+// GPU-less machines.
+//
+// Per frame: beginFrame(viewProj), addOccluder() for each occluder, render(),
+// then visible() / filter() for the candidates that survived frustum culling.
+// Matrices are column-major; depth is GL's, mapped to [0, 1].
+class OcclusionCuller {
+public:
+   struct Stats {
+      size_t occluderTriangles = 0; // after near-plane clipping
+      size_t tested = 0;
+      size_t occluded = 0;
+      double rasterMs = 0.0;
+      double pyramidMs = 0.0;
+      double testMs = 0.0;
+   };
+
+   static constexpr int kBandRows = 8;
+
+   // width is rounded up to a multiple of 4 for the SIMD spans
+   OcclusionCuller(JobSystem& jobs, int width = 256, int height = 128)
+   : jobs(jobs), width((width + 3) & ~3), height(height) {
+      int w = this->width, h = height;
+      do {
+         levels.push_back({w, h, std::vector<float>(size_t(w) * h, 1.0f)});
+         w = std::max(1, (w + 1) / 2);
+         h = std::max(1, (h + 1) / 2);
+      } while (levels.back().width > 1 || levels.back().height > 1);
+   }
+
+   void beginFrame(const float* viewProj) {
+      std::memcpy(viewProjection, viewProj, sizeof(viewProjection));
+      triangles.clear();
+      frameStats = Stats();
+   }
+
+   // Positions are xyz triples; model may be null for world-space meshes.
+   // Occluders should sit inside the objects they stand for, since anything
+   // they cover is assumed hidden.
+   void addOccluder(const float* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount, const float* model = nullptr) {
+      float mvp[16];
+      if (model) SceneGraph::multiply(viewProjection, model, mvp);
+      else std::memcpy(mvp, viewProjection, sizeof(mvp));
+
+      clip.resize(vertexCount);
+      for (size_t v = 0; v < vertexCount; ++v) {
+         const float* p = positions + v * 3;
+         for (int r = 0; r < 4; ++r) clip[v].c[r] = mvp[r] * p[0] + mvp[4 + r] * p[1] + mvp[8 + r] * p[2] + mvp[12 + r];
+      }
+      for (size_t i = 0; i + 2 < indexCount; i += 3) {
+         clipAndEmit(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+      }
+   }
+
+   // Rasterizes the occluders and builds the depth pyramid
+   void render() {
+      auto start = std::chrono::steady_clock::now();
+      frameStats.occluderTriangles = triangles.size();
+
+      size_t bands = size_t((height + kBandRows - 1) / kBandRows);
+      jobs.parallelFor(bands, 1, [this](size_t begin, size_t end) {
+         for (size_t band = begin; band < end; ++band) rasterBand(int(band) * kBandRows);
+      });
+      auto rastered = std::chrono::steady_clock::now();
+      frameStats.rasterMs = std::chrono::duration<double, std::milli>(rastered - start).count();
+
+      for (size_t l = 1; l < levels.size(); ++l) {
+         const Level& src = levels[l - 1];
+         Level& dst = levels[l];
+         jobs.parallelFor(size_t(dst.height), 16, [&src, &dst](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) downsampleRow(src, dst, int(y));
+         });
+      }
+      frameStats.pyramidMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rastered).count();
+   }
+
+   // False only when every point of box is certainly hidden. Boxes crossing
+   // the near plane or leaving the screen count as visible; frustum culling
+   // is the BVH's job.
+   bool visible(const Aabb& box) const {
+      // Corners are the min corner plus any of the three edge vectors, so
+      // project those once and add instead of transforming eight points
+      const float* m = viewProjection;
+      float base[4], edge[3][4];
+      for (int r = 0; r < 4; ++r) {
+         base[r] = m[r] * box.min[0] + m[4 + r] * box.min[1] + m[8 + r] * box.min[2] + m[12 + r];
+         for (int a = 0; a < 3; ++a) edge[a][r] = m[a * 4 + r] * (box.max[a] - box.min[a]);
+      }
+
+      float minX, minY, maxX, maxY, nearest;
+#if defined(OCCLUSION_CULLER_SSE)
+      // Lanes are corners 0-3 (x/y edges toggled); the +z corners add edge 2
+      const __m128 mx = _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f), my = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+      __m128 lo[4], hi[4];
+      for (int r = 0; r < 4; ++r) {
+         lo[r] = _mm_add_ps(_mm_set1_ps(base[r]), _mm_add_ps(_mm_mul_ps(mx, _mm_set1_ps(edge[0][r])), _mm_mul_ps(my, _mm_set1_ps(edge[1][r]))));
+         hi[r] = _mm_add_ps(lo[r], _mm_set1_ps(edge[2][r]));
+      }
+      if (_mm_movemask_ps(_mm_or_ps(_mm_cmple_ps(lo[3], _mm_set1_ps(kMinW)), _mm_cmple_ps(hi[3], _mm_set1_ps(kMinW))))) return true;
+
+      const __m128 one = _mm_set1_ps(1.0f);
+      __m128 invLo = _mm_div_ps(one, lo[3]), invHi = _mm_div_ps(one, hi[3]);
+      __m128 xLo = _mm_mul_ps(lo[0], invLo), xHi = _mm_mul_ps(hi[0], invHi);
+      __m128 yLo = _mm_mul_ps(lo[1], invLo), yHi = _mm_mul_ps(hi[1], invHi);
+      __m128 zLo = _mm_mul_ps(lo[2], invLo), zHi = _mm_mul_ps(hi[2], invHi);
+      minX = horizontalMin(_mm_min_ps(xLo, xHi));
+      maxX = horizontalMax(_mm_max_ps(xLo, xHi));
+      minY = horizontalMin(_mm_min_ps(yLo, yHi));
+      maxY = horizontalMax(_mm_max_ps(yLo, yHi));
+      nearest = horizontalMin(_mm_min_ps(zLo, zHi));
+#else
+      minX = minY = nearest = 1e30f;
+      maxX = maxY = -1e30f;
+      for (int corner = 0; corner < 8; ++corner) {
+         float c[4];
+         for (int r = 0; r < 4; ++r) {
+            c[r] = base[r];
+            if (corner & 1) c[r] += edge[0][r];
+            if (corner & 2) c[r] += edge[1][r];
+            if (corner & 4) c[r] += edge[2][r];
+         }
+         if (c[3] <= kMinW) return true;
+         float inv = 1.0f / c[3];
+         minX = std::min(minX, c[0] * inv);
+         maxX = std::max(maxX, c[0] * inv);
+         minY = std::min(minY, c[1] * inv);
+         maxY = std::max(maxY, c[1] * inv);
+         nearest = std::min(nearest, c[2] * inv);
+      }
+#endif
+      // NDC to pixels / [0, 1] depth
+      minX = (minX * 0.5f + 0.5f) * float(width);
+      maxX = (maxX * 0.5f + 0.5f) * float(width);
+      minY = (minY * 0.5f + 0.5f) * float(height);
+      maxY = (maxY * 0.5f + 0.5f) * float(height);
+      nearest = nearest * 0.5f + 0.5f;
+      if (maxX < 0.0f || maxY < 0.0f || minX >= float(width) || minY >= float(height)) return true;
+
+      int x0 = std::max(0, int(minX)), y0 = std::max(0, int(minY));
+      int x1 = std::min(width - 1, int(maxX)), y1 = std::min(height - 1, int(maxY));
+
+      // Coarsest level at which the rect spans at most two texels each way
+      size_t level = 0;
+      while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) ++level;
+
+      const Level& lv = levels[level];
+      float farthest = 0.0f;
+      for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+         for (int x = x0 >> level; x <= (x1 >> level); ++x) farthest = std::max(farthest, lv.depth[size_t(y) * lv.width + x]);
+      }
+      return nearest <= farthest;
+   }
+
+   // Appends to out the candidates whose box (from boxOf(candidate)) is not
+   // occluded. Tests run as parallel jobs; order is preserved.
+   template <typename BoxFn>
+   void filter(const std::vector<uint32_t>& candidates, BoxFn boxOf, std::vector<uint32_t>& out) {
+      auto start = std::chrono::steady_clock::now();
+      const size_t grain = 1024;
+      size_t chunks = (candidates.size() + grain - 1) / grain;
+      chunkResults.resize(chunks);
+      jobs.parallelFor(candidates.size(), grain, [&](size_t begin, size_t end) {
+         std::vector<uint32_t>& result = chunkResults[begin / grain];
+         result.clear();
+         for (size_t i = begin; i < end; ++i) {
+            if (visible(boxOf(candidates[i]))) result.push_back(candidates[i]);
+         }
+      });
+
+      size_t before = out.size();
+      for (size_t c = 0; c < chunks; ++c) out.insert(out.end(), chunkResults[c].begin(), chunkResults[c].end());
+      frameStats.tested += candidates.size();
+      frameStats.occluded += candidates.size() - (out.size() - before);
+      frameStats.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+   }
+
+   const Stats& stats() const { return frameStats; }
+
+   // Level 0 is the rasterized depth, row 0 at the bottom; for debugging views
+   const float* depthBuffer() const { return levels[0].depth.data(); }
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+
+private:
+   struct ClipVertex {
+      float c[4];
+   };
+
+   struct ScreenTriangle {
+      float x[3], y[3], z[3];
+      int minY, maxY;
+   };
+
+   struct Level {
+      int width;
+      int height;
+      std::vector<float> depth;
+   };
+
+   static constexpr float kMinW = 1e-5f;
+
+   JobSystem& jobs;
+   int width;
+   int height;
+   float viewProjection[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+   std::vector<Level> levels;
+   std::vector<ScreenTriangle> triangles;
+   std::vector<ClipVertex> clip;
+   std::vector<std::vector<uint32_t>> chunkResults;
+   Stats frameStats;
+
+   // Clips against the near plane (z >= -w); a triangle can become a quad
+   void clipAndEmit(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+      const ClipVertex* in[3] = {&a, &b, &c};
+      ClipVertex out[4];
+      int count = 0;
+      for (int i = 0; i < 3; ++i) {
+         const ClipVertex& p = *in[i];
+         const ClipVertex& q = *in[(i + 1) % 3];
+         float dp = p.c[2] + p.c[3], dq = q.c[2] + q.c[3];
+         if (dp >= 0.0f) out[count++] = p;
+         if ((dp >= 0.0f) != (dq >= 0.0f)) {
+            float t = dp / (dp - dq);
+            ClipVertex& v = out[count++];
+            for (int k = 0; k < 4; ++k) v.c[k] = p.c[k] + t * (q.c[k] - p.c[k]);
+         }
+      }
+      for (int i = 1; i + 1 < count; ++i) emitScreen(out[0], out[i], out[i + 1]);
+   }
+
+   void emitScreen(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+      const ClipVertex* v[3] = {&a, &b, &c};
+      ScreenTriangle t;
+      float lo = 1e30f, hi = -1e30f;
+      for (int i = 0; i < 3; ++i) {
+         float w = std::max(v[i]->c[3], kMinW);
+         t.x[i] = (v[i]->c[0] / w * 0.5f + 0.5f) * float(width);
+         t.y[i] = (v[i]->c[1] / w * 0.5f + 0.5f) * float(height);
+         t.z[i] = v[i]->c[2] / w * 0.5f + 0.5f;
+         lo = std::min(lo, t.y[i]);
+         hi = std::max(hi, t.y[i]);
+      }
+      float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+      if (std::fabs(area) < 1e-6f) return;
+      // Occluders are drawn two-sided; keep one winding for the edge tests
+      if (area < 0.0f) {
+         std::swap(t.x[1], t.x[2]);
+         std::swap(t.y[1], t.y[2]);
+         std::swap(t.z[1], t.z[2]);
+      }
+      t.minY = std::max(0, int(std::floor(lo - 0.5f)));
+      t.maxY = std::min(height - 1, int(std::ceil(hi - 0.5f)));
+      if (t.minY > t.maxY) return;
+      triangles.push_back(t);
+   }
+
+   // One job: clears rows [y0, y0 + kBandRows) and draws every triangle that
+   // touches them. Bands never share pixels, so no locking.
+   void rasterBand(int y0) {
+      int y1 = std::min(height, y0 + kBandRows) - 1;
+      Level& target = levels[0];
+      std::fill(target.depth.begin() + size_t(y0) * width, target.depth.begin() + size_t(y1 + 1) * width, 1.0f);
+
+      for (const ScreenTriangle& t : triangles) {
+         if (t.maxY < y0 || t.minY > y1) continue;
+
+         // Edge i is opposite vertex i: e(x, y) = A x + B y + C >= 0 inside
+         float A[3], B[3], C[3];
+         for (int i = 0; i < 3; ++i) {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            A[i] = t.y[j] - t.y[k];
+            B[i] = t.x[k] - t.x[j];
+            C[i] = t.x[j] * t.y[k] - t.x[k] * t.y[j];
+         }
+         float area = C[0] + C[1] + C[2];
+         if (area <= 0.0f) continue;
+         float inv = 1.0f / area;
+
+         // Depth is linear in screen space: z = zA x + zB y + zC
+         float zA = (A[0] * t.z[0] + A[1] * t.z[1] + A[2] * t.z[2]) * inv;
+         float zB = (B[0] * t.z[0] + B[1] * t.z[1] + B[2] * t.z[2]) * inv;
+         float zC = (C[0] * t.z[0] + C[1] * t.z[1] + C[2] * t.z[2]) * inv;
+
+         float fx0 = std::min({t.x[0], t.x[1], t.x[2]}), fx1 = std::max({t.x[0], t.x[1], t.x[2]});
+         int x0 = std::max(0, int(std::floor(fx0 - 0.5f))) & ~3;
+         int x1 = std::min(width - 1, int(std::ceil(fx1 - 0.5f)));
+         if (x0 > x1) continue;
+
+         for (int y = std::max(y0, t.minY); y <= std::min(y1, t.maxY); ++y) {
+            float py = float(y) + 0.5f;
+            float* row = target.depth.data() + size_t(y) * width;
+            rasterSpan(row, x0, x1, py, A, B, C, zA, zB, zC);
+         }
+      }
+   }
+
+   static void rasterSpan(float* row, int x0, int x1, float py, const float* A, const float* B, const float* C,
+                          float zA, float zB, float zC) {
+#if defined(OCCLUSION_CULLER_SSE)
+      const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]), za = _mm_set1_ps(zA);
+      const __m128 r0 = _mm_set1_ps(B[0] * py + C[0]), r1 = _mm_set1_ps(B[1] * py + C[1]), r2 = _mm_set1_ps(B[2] * py + C[2]);
+      const __m128 rz = _mm_set1_ps(zB * py + zC);
+      for (int x = x0; x <= x1; x += 4) {
+         __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lane);
+         __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+         __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+         __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+         __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+         if (_mm_movemask_ps(inside) == 0) continue;
+
+         __m128 z = _mm_add_ps(_mm_mul_ps(za, px), rz);
+         __m128 old = _mm_loadu_ps(row + x);
+         __m128 nearer = _mm_min_ps(old, z);
+         _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+      }
+#else
+      for (int x = x0; x <= x1; ++x) {
+         float px = float(x) + 0.5f;
+         if (A[0] * px + B[0] * py + C[0] < 0.0f) continue;
+         if (A[1] * px + B[1] * py + C[1] < 0.0f) continue;
+         if (A[2] * px + B[2] * py + C[2] < 0.0f) continue;
+         row[x] = std::min(row[x], zA * px + zB * py + zC);
+      }
+#endif
+   }
+
+#if defined(OCCLUSION_CULLER_SSE)
+   static float horizontalMin(__m128 v) {
+      v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+      v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(v);
+   }
+
+   static float horizontalMax(__m128 v) {
+      v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+      v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(v);
+   }
+#endif
+
+   // dst texel = farthest of the (up to) 2x2 src texels under it
+   static void downsampleRow(const Level& src, Level& dst, int y) {
+      int sy0 = std::min(src.height - 1, y * 2), sy1 = std::min(src.height - 1, y * 2 + 1);
+      const float* a = src.depth.data() + size_t(sy0) * src.width;
+      const float* b = src.depth.data() + size_t(sy1) * src.width;
+      float* out = dst.depth.data() + size_t(y) * dst.width;
+      for (int x = 0; x < dst.width; ++x) {
+         int sx0 = std::min(src.width - 1, x * 2), sx1 = std::min(src.width - 1, x * 2 + 1);
+         out[x] = std::max(std::max(a[sx0], a[sx1]), std::max(b[sx0], b[sx1]));
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "gl_state_cache.h"
+
+// Sort key layout, most significant first:
+//   [63..60] pass  [59..48] shader  [47..32] material  [31..0] depth
+// Sorting by key groups draws by pass, then program, then material, so the
+// state cache sees as few changes as possible; depth orders draws within that.
+struct SortKey {
+   static uint64_t make(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depth) {
+      return (uint64_t(pass & 0xF) << 60) |
+             (uint64_t(shader & 0xFFF) << 48) |
+             (uint64_t(material & 0xFFFF) << 32) |
+             uint64_t(depth);
+   }
+
+   // Maps a non-negative view depth to bits that sort front to back, or back
+   // to front for blended passes.
+   static uint32_t depthBits(float viewDepth, bool backToFront = false) {
+      if (viewDepth < 0.0f) viewDepth = 0.0f;
+      uint32_t bits;
+      std::memcpy(&bits, &viewDepth, sizeof(bits));
+      return backToFront ? ~bits : bits;
+   }
+};
+
+struct DrawPacket {
+   uint64_t key;
+   GLuint program;
+   GLuint vertexArray;
+   GLuint texture;        // bound to unit 0 as GL_TEXTURE_2D when non-zero
+   GLenum mode;
+   GLenum indexType;      // 0 for glDrawArrays*, else GL_UNSIGNED_*
+   GLint first;           // first vertex, or byte offset into the element buffer
+   GLsizei count;
+   GLsizei instances;     // 1 for a plain draw
+   GLint baseVertex;
+};
+
+// Draw packets recorded by a single thread. Obtain one from
+// RenderQueue::acquireBuffer() and record into it without locking.
+class CommandBuffer {
+public:
+   void draw(const DrawPacket& packet) { packets.push_back(packet); }
+
+   void drawArrays(uint64_t key, GLuint program, GLuint vao, GLenum mode, GLint first, GLsizei count,
+                   GLsizei instances = 1, GLuint texture = 0) {
+      packets.push_back({key, program, vao, texture, mode, 0, first, count, instances, 0});
+   }
+
+   void drawElements(uint64_t key, GLuint program, GLuint vao, GLenum mode, GLsizei count, GLenum indexType,
+                     size_t indexOffset, GLint baseVertex = 0, GLsizei instances = 1, GLuint texture = 0) {
+      packets.push_back({key, program, vao, texture, mode, indexType, GLint(indexOffset), count, instances, baseVertex});
+   }
+
+   size_t size() const { return packets.size(); }
+   void clear() { packets.clear(); }
+
+private:
+   friend class RenderQueue;
+   std::vector<DrawPacket> packets;
+};
+
+// Collects draw packets from any number of threads and executes them in
+// sort-key order on the render thread.
+class RenderQueue {
+public:
+   struct Stats {
+      size_t packets = 0;
+      size_t drawCalls = 0; // packets that drew anything; empty ones are dropped
+      double sortMs = 0.0;
+      double executeMs = 0.0;
+   };
+
+   // Returns a buffer owned by the calling thread until the next submit().
+   // Only acquisition takes a lock; recording into the buffer does not.
+   CommandBuffer& acquireBuffer() {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (used == buffers.size()) buffers.push_back(std::make_unique<CommandBuffer>());
+      return *buffers[used++];
+   }
+
+   // Merges every buffer acquired this frame, radix-sorts by key and issues
+   // the draws through the state cache. Recording threads must have finished.
+   void submit(GLStateCache& state) {
+      auto start = std::chrono::steady_clock::now();
+
+      merged.clear();
+      size_t total = 0;
+      for (size_t b = 0; b < used; ++b) total += buffers[b]->packets.size();
+      merged.reserve(total);
+      for (size_t b = 0; b < used; ++b) {
+         auto& p = buffers[b]->packets;
+         merged.insert(merged.end(), p.begin(), p.end());
+         p.clear();
+      }
+      used = 0;
+
+      sortByKey();
+      auto sorted = std::chrono::steady_clock::now();
+
+      size_t drawCalls = 0;
+      for (const Entry& e : order) drawCalls += execute(merged[e.index], state) ? 1 : 0;
+      auto done = std::chrono::steady_clock::now();
+
+      stats.packets = total;
+      stats.drawCalls = drawCalls;
+      stats.sortMs = std::chrono::duration<double, std::milli>(sorted - start).count();
+      stats.executeMs = std::chrono::duration<double, std::milli>(done - sorted).count();
+   }
+
+   const Stats& lastStats() const { return stats; }
+
+private:
+   struct Entry {
+      uint64_t key;
+      uint32_t index;
+   };
+
+   std::mutex mutex;
+   std::vector<std::unique_ptr<CommandBuffer>> buffers;
+   size_t used = 0;
+
+   std::vector<DrawPacket> merged;
+   std::vector<Entry> order;
+   std::vector<Entry> scratch;
+   Stats stats;
+
+   // LSD radix sort over 8-bit digits. Digits on which every key agrees
+   // (typically most of the pass and shader bytes) are skipped.
+   void sortByKey() {
+      size_t n = merged.size();
+      order.resize(n);
+      scratch.resize(n);
+      for (size_t i = 0; i < n; ++i) order[i] = {merged[i].key, uint32_t(i)};
+      if (n < 2) return;
+
+      size_t histograms[8][256] = {};
+      for (const Entry& e : order) {
+         for (int d = 0; d < 8; ++d) ++histograms[d][(e.key >> (d * 8)) & 0xFF];
+      }
+
+      for (int d = 0; d < 8; ++d) {
+         size_t* h = histograms[d];
+         if (h[(order[0].key >> (d * 8)) & 0xFF] == n) continue;
+
+         size_t sum = 0;
+         for (int i = 0; i < 256; ++i) {
+            size_t c = h[i];
+            h[i] = sum;
+            sum += c;
+         }
+         for (const Entry& e : order) scratch[h[(e.key >> (d * 8)) & 0xFF]++] = e;
+         order.swap(scratch);
+      }
+   }
+
+   // False for packets with nothing to draw, which change no state either
+   static bool execute(const DrawPacket& p, GLStateCache& state) {
+      if (p.count <= 0 || p.instances <= 0) return false;
+      state.useProgram(p.program);
+      state.bindVertexArray(p.vertexArray);
+      if (p.texture) state.bindTexture(0, GL_TEXTURE_2D, p.texture);
+
+      if (p.indexType == 0) {
+         if (p.instances == 1) glDrawArrays(p.mode, p.first, p.count);
+         else glDrawArraysInstanced(p.mode, p.first, p.count, p.instances);
+      } else {
+         const void* offset = reinterpret_cast<const void*>(static_cast<uintptr_t>(p.first));
+         glDrawElementsInstancedBaseVertex(p.mode, p.count, p.indexType, offset, p.instances, p.baseVertex);
+      }
+      return true;
+   }
+};
+
+#endif
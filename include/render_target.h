@@ -0,0 +1,88 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+#include "gl_state_cache.h"
+
+// Offscreen framebuffer with an RGBA8 color texture and a depth renderbuffer.
+// Its contents persist across frames, which the default framebuffer does not
+// guarantee after a swap. Binds go through the context's GLStateCache.
+class RenderTarget {
+public:
+   ~RenderTarget() { deleteObjects(); }
+
+   bool resize(GLStateCache& state, int w, int h) {
+      if (w == width && h == height && fbo) return true;
+      destroy(state);
+      width = w;
+      height = h;
+
+      glGenFramebuffers(1, &fbo);
+      state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+      glGenTextures(1, &color);
+      state.bindTexture(0, GL_TEXTURE_2D, color);
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+
+      glGenRenderbuffers(1, &depth);
+      glBindRenderbuffer(GL_RENDERBUFFER, depth);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+      bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+      state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+      if (!complete) {
+         std::cerr << "RenderTarget: framebuffer incomplete at " << w << "x" << h << std::endl;
+         destroy(state);
+      }
+      return complete;
+   }
+
+   void bind(GLStateCache& state) const {
+      state.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+      glViewport(0, 0, width, height);
+   }
+
+   // Copies the whole target into the default framebuffer.
+   void blitToDefault(GLStateCache& state) const {
+      state.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+      state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+   }
+
+   // Deletes the GL objects; needs the context current. resize() creates
+   // them again.
+   void destroy(GLStateCache& state) {
+      state.forgetFramebuffer(fbo);
+      state.forgetTexture(color);
+      deleteObjects();
+   }
+
+   GLuint framebuffer() const { return fbo; }
+   GLuint colorTexture() const { return color; }
+   int getWidth() const { return width; }
+   int getHeight() const { return height; }
+
+private:
+   GLuint fbo = 0;
+   GLuint color = 0;
+   GLuint depth = 0;
+   int width = 0;
+   int height = 0;
+
+   void deleteObjects() {
+      if (depth) glDeleteRenderbuffers(1, &depth);
+      if (color) glDeleteTextures(1, &color);
+      if (fbo) glDeleteFramebuffers(1, &fbo);
+      fbo = color = depth = 0;
+   }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "frame_stats.h"
+#include "native_window_manager.h"
+
+// Runs GL submission on its own thread, which owns the NativeWindowManager
+// context while started. The simulation (main) thread keeps window events
+// and scripting, fills a frame packet and submit()s it; the render thread
+// draws and presents that packet while the next one is being built, so a
+// script-heavy frame and a draw-heavy frame overlap instead of adding up.
+//
+// Packets are double-buffered: one being written by the simulation, one
+// being read by the renderer. submit() only blocks when the simulation gets a
+// full frame ahead of the renderer.
+template <typename Packet>
+class RenderThread {
+public:
+   using RenderFn = std::function<void(const Packet&)>;
+
+   RenderThread(NativeWindowManager& window, RenderFn render)
+   : window(window), render(std::move(render)) {}
+
+   ~RenderThread() { stop(); }
+
+   RenderThread(const RenderThread&) = delete;
+   RenderThread& operator=(const RenderThread&) = delete;
+
+   // Hands the context from the calling thread to the render thread.
+   void start() {
+      if (thread.joinable()) return;
+      stopping = false;
+      window.releaseContext();
+      thread = std::thread(&RenderThread::renderLoop, this);
+   }
+
+   // Finishes the packet in flight, then gives the context back to the caller.
+   void stop() {
+      if (!thread.joinable()) return;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         stopping = true;
+      }
+      cv.notify_all();
+      thread.join();
+      window.makeContextCurrent();
+   }
+
+   // The packet the simulation is filling for the next frame.
+   Packet& packet() { return packets[writeIndex]; }
+
+   // Publishes packet() and switches to the other buffer. Waits only while the
+   // render thread is still reading that buffer.
+   void submit() {
+      auto start = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return !hasPending && !rendering; });
+      readIndex = writeIndex;
+      writeIndex = 1 - writeIndex;
+      hasPending = true;
+      lock.unlock();
+      cv.notify_all();
+      submitWaitStats.push(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+   }
+
+   // Render thread time from picking up a packet to presenting it. Read after stop().
+   const FrameStats& renderStats() const { return renderFrameStats; }
+   // How long the simulation thread was held up in submit().
+   const FrameStats& submitWaitTimes() const { return submitWaitStats; }
+
+private:
+   NativeWindowManager& window;
+   RenderFn render;
+
+   Packet packets[2];
+   int writeIndex = 0;
+   int readIndex = 1;
+   bool hasPending = false;
+   bool rendering = false;
+   bool stopping = false;
+
+   std::mutex mutex;
+   std::condition_variable cv;
+   std::thread thread;
+
+   FrameStats renderFrameStats;
+   FrameStats submitWaitStats;
+
+   void renderLoop() {
+      window.makeContextCurrent();
+
+      for (;;) {
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || hasPending; });
+            if (!hasPending) break;
+            hasPending = false;
+            rendering = true;
+         }
+
+         auto start = std::chrono::steady_clock::now();
+         // Packets are drawn to the window itself, never to the on-demand
+         // offscreen target
+         window.applyPendingResize(true);
+         GpuProfiler& gpu = window.getGpuProfiler();
+         gpu.beginFrame();
+         render(packets[readIndex]);
+         gpu.endFrame();
+         window.present();
+         renderFrameStats.push(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            rendering = false;
+         }
+         cv.notify_all();
+      }
+
+      window.releaseContext();
+   }
+};
+
+#endif
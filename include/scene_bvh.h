@@ -0,0 +1,609 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_BVH_SSE 1
+#endif
+
+struct Aabb {
+   float min[3];
+   float max[3];
+
+   // Inverted box: fails every frustum test and is absorbed by merges
+   static Aabb empty() { return {{kFar, kFar, kFar}, {-kFar, -kFar, -kFar}}; }
+
+   void merge(const Aabb& other) {
+      for (int i = 0; i < 3; ++i) {
+         min[i] = std::min(min[i], other.min[i]);
+         max[i] = std::max(max[i], other.max[i]);
+      }
+   }
+
+   float surfaceArea() const {
+      float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+      if (dx < 0.0f || dy < 0.0f || dz < 0.0f) return 0.0f;
+      return 2.0f * (dx * dy + dy * dz + dz * dx);
+   }
+
+   // Finite so that zero plane coefficients never produce 0 * inf
+   static constexpr float kFar = 1e30f;
+};
+
+// Six planes (ax + by + cz + d >= 0 inside) taken from a column-major
+// view-projection matrix, the layout GL and InstanceData use.
+struct Frustum {
+   float planes[6][4];
+
+   static Frustum fromMatrix(const float* m) {
+      Frustum f;
+      for (int i = 0; i < 3; ++i) {
+         for (int c = 0; c < 4; ++c) {
+            float w = m[c * 4 + 3];
+            float r = m[c * 4 + i];
+            f.planes[i * 2][c] = w + r;
+            f.planes[i * 2 + 1][c] = w - r;
+         }
+      }
+      return f;
+   }
+};
+
+// Per-frame culling counters
+struct CullStats {
+   uint64_t nodesVisited = 0;
+   uint64_t boxesTested = 0;
+   uint64_t acceptedWhole = 0; // subtrees emitted without testing their objects
+   uint64_t visible = 0;
+   uint64_t culled = 0;
+   double ms = 0.0;
+};
+
+// Dynamic bounding volume hierarchy for frustum culling. Four-wide: every node
+// keeps the boxes of its four children side by side, so one SSE pass tests all
+// of them against a plane. Objects under a node occupy a contiguous slot range,
+// which lets subtrees fully inside the frustum be emitted without descending.
+//
+// move() only refits (update() grows boxes up the dirty path); a subtree whose
+// surface area has more than doubled since it was built is rebuilt on its own.
+// Objects added after the last build are tested linearly until the next full
+// rebuild, which update() triggers once they, removals or abandoned nodes
+// pile up.
+class SceneBvh {
+public:
+   using ObjectId = uint32_t;
+   static constexpr uint32_t kLeafSize = 8;
+   static constexpr float kRebuildGrowth = 2.0f;
+
+   ObjectId add(const Aabb& box, uint32_t userData) {
+      ObjectId id;
+      if (!freeIds.empty()) {
+         id = freeIds.back();
+         freeIds.pop_back();
+      } else {
+         id = ObjectId(idToSlot.size());
+         idToSlot.push_back(0);
+      }
+      uint32_t slot = uint32_t(slotToId.size());
+      idToSlot[id] = slot;
+      slotToId.push_back(id);
+      user.push_back(userData);
+      alive.push_back(1);
+      leafOf.push_back({-1, 0});
+      for (auto& axis : bounds) axis.push_back(0.0f);
+      storeBox(slot, box);
+      ++liveCount;
+      return id;
+   }
+
+   void move(ObjectId id, const Aabb& box) {
+      uint32_t slot = idToSlot[id];
+      storeBox(slot, box);
+      LeafRef leaf = leafOf[slot];
+      if (leaf.node >= 0) dirty[size_t(leaf.node)] = 1;
+      moved = true;
+   }
+
+   void remove(ObjectId id) {
+      uint32_t slot = idToSlot[id];
+      storeBox(slot, Aabb::empty());
+      alive[slot] = 0;
+      freeIds.push_back(id);
+      --liveCount;
+      ++deadCount;
+   }
+
+   uint32_t userData(ObjectId id) const { return user[idToSlot[id]]; }
+   size_t size() const { return liveCount; }
+   size_t nodeCount() const { return nodes.size() - garbageNodes; }
+
+   // Once per frame, before cull(): refits moved objects, rebuilds degraded
+   // subtrees and falls back to a full rebuild when that is cheaper.
+   void update() {
+      size_t unindexed = slotToId.size() - indexedCount;
+      if (nodes.empty() || unindexed > std::max<size_t>(64, indexedCount / 32) ||
+          deadCount > indexedCount / 4 || garbageNodes > nodes.size() / 2) {
+         rebuild();
+         return;
+      }
+      if (!moved) return;
+      refit();
+      rebuildDegraded();
+      moved = false;
+   }
+
+   void rebuild() {
+      compact();
+      nodes.clear();
+      dirty.clear();
+      garbageNodes = 0;
+      moved = false;
+      indexedCount = uint32_t(slotToId.size());
+
+      std::vector<BuildRef> refs = makeRefs(0, indexedCount);
+      buildNode(refs, 0, 0, indexedCount, -1, 0);
+      applyOrder(refs, 0, 0);
+   }
+
+   // Appends the userData of every object intersecting the frustum
+   void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats* stats = nullptr) const {
+      auto start = std::chrono::steady_clock::now();
+      CullStats local;
+      size_t before = visible.size();
+
+      if (!nodes.empty()) {
+         struct Entry { int32_t node; uint32_t planes; };
+         Entry stack[64];
+         int top = 0;
+         stack[top++] = {0, kAllPlanes};
+
+         while (top) {
+            Entry entry = stack[--top];
+            const Node& node = nodes[size_t(entry.node)];
+            ++local.nodesVisited;
+            local.boxesTested += 4;
+
+            uint32_t childPlanes[4];
+            unsigned outside = testBoxes(frustum, entry.planes, node.minX, node.minY, node.minZ,
+                                         node.maxX, node.maxY, node.maxZ, childPlanes);
+
+            for (int c = 0; c < 4; ++c) {
+               if (node.count[c] == 0 || (outside >> c) & 1u) continue;
+               if (childPlanes[c] == 0) {
+                  ++local.acceptedWhole;
+                  emitRange(node.first[c], node.count[c], visible);
+               } else if (node.child[c] >= 0 && top < 64) {
+                  stack[top++] = {node.child[c], childPlanes[c]};
+               } else if (node.child[c] >= 0) {
+                  // Deeper than any balanced build gets; accept conservatively
+                  emitRange(node.first[c], node.count[c], visible);
+               } else {
+                  local.boxesTested += node.count[c];
+                  testObjects(frustum, childPlanes[c], node.first[c], node.count[c], visible);
+               }
+            }
+         }
+      }
+
+      // Added since the last build
+      uint32_t tail = uint32_t(slotToId.size()) - indexedCount;
+      local.boxesTested += tail;
+      testObjects(frustum, kAllPlanes, indexedCount, tail, visible);
+
+      local.visible = visible.size() - before;
+      local.culled = liveCount - local.visible;
+      local.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      if (stats) *stats = local;
+   }
+
+private:
+   static constexpr uint32_t kAllPlanes = 0x3f;
+
+   // A child is either another node (child >= 0) or a leaf (child < 0) whose
+   // objects are slots [first, first + count). count == 0 marks an unused slot.
+   struct alignas(16) Node {
+      float minX[4], minY[4], minZ[4];
+      float maxX[4], maxY[4], maxZ[4];
+      int32_t child[4];
+      uint32_t first[4];
+      uint32_t count[4];
+      float builtArea[4];
+      int32_t parent;
+      int32_t parentSlot;
+   };
+
+   struct LeafRef {
+      int32_t node;
+      int32_t slot;
+   };
+
+   std::vector<Node> nodes;
+   std::vector<uint8_t> dirty;
+   // Object boxes, SoA by slot: minX, minY, minZ, maxX, maxY, maxZ
+   std::vector<float> bounds[6];
+   std::vector<uint32_t> user;
+   std::vector<uint8_t> alive;
+   std::vector<LeafRef> leafOf;
+   std::vector<ObjectId> slotToId;
+   std::vector<uint32_t> idToSlot;
+   std::vector<ObjectId> freeIds;
+
+   uint32_t indexedCount = 0;
+   size_t liveCount = 0;
+   size_t deadCount = 0;
+   size_t garbageNodes = 0;
+   bool moved = false;
+
+   void storeBox(uint32_t slot, const Aabb& box) {
+      for (int i = 0; i < 3; ++i) {
+         bounds[i][slot] = box.min[i];
+         bounds[i + 3][slot] = box.max[i];
+      }
+   }
+
+   Aabb objectBox(uint32_t slot) const {
+      return {{bounds[0][slot], bounds[1][slot], bounds[2][slot]},
+              {bounds[3][slot], bounds[4][slot], bounds[5][slot]}};
+   }
+
+   Aabb rangeBox(uint32_t first, uint32_t count) const {
+      Aabb box = Aabb::empty();
+      for (uint32_t s = first; s < first + count; ++s) box.merge(objectBox(s));
+      return box;
+   }
+
+   static void setChildBox(Node& node, int c, const Aabb& box) {
+      node.minX[c] = box.min[0];
+      node.minY[c] = box.min[1];
+      node.minZ[c] = box.min[2];
+      node.maxX[c] = box.max[0];
+      node.maxY[c] = box.max[1];
+      node.maxZ[c] = box.max[2];
+   }
+
+   static Aabb childBox(const Node& node, int c) {
+      return {{node.minX[c], node.minY[c], node.minZ[c]}, {node.maxX[c], node.maxY[c], node.maxZ[c]}};
+   }
+
+   // What the builder shuffles: the box travels with the slot so splits
+   // never touch the object arrays
+   struct BuildRef {
+      float min[3];
+      float max[3];
+      uint32_t slot;
+      float centroid(int axis) const { return min[axis] + max[axis]; }
+   };
+
+   std::vector<BuildRef> makeRefs(uint32_t first, uint32_t count) const {
+      std::vector<BuildRef> refs(count);
+      for (uint32_t i = 0; i < count; ++i) {
+         BuildRef& ref = refs[i];
+         uint32_t s = first + i;
+         for (int a = 0; a < 3; ++a) {
+            ref.min[a] = bounds[a][s];
+            ref.max[a] = bounds[a + 3][s];
+         }
+         ref.slot = s;
+      }
+      return refs;
+   }
+
+   // Splits positions [first, first + count) into up to four ranges, largest
+   // first, at the centroid median of the longest axis; recurses on ranges
+   // that are still bigger than a leaf. refs[0] is position base. Returns the
+   // new node's index.
+   int32_t buildNode(std::vector<BuildRef>& refs, uint32_t base, uint32_t first, uint32_t count, int32_t parent, int32_t parentSlot) {
+      int32_t index = int32_t(nodes.size());
+      nodes.emplace_back();
+      dirty.push_back(0);
+      {
+         Node& node = nodes.back();
+         for (int c = 0; c < 4; ++c) {
+            setChildBox(node, c, Aabb::empty());
+            node.child[c] = -1;
+            node.first[c] = first;
+            node.count[c] = 0;
+            node.builtArea[c] = 0.0f;
+         }
+         node.parent = parent;
+         node.parentSlot = parentSlot;
+      }
+
+      std::pair<uint32_t, uint32_t> parts[4] = {{first, count}};
+      int partCount = 1;
+      while (partCount < 4) {
+         int widest = -1;
+         for (int i = 0; i < partCount; ++i) {
+            if (parts[i].second > kLeafSize && (widest < 0 || parts[i].second > parts[widest].second)) widest = i;
+         }
+         if (widest < 0) break;
+
+         uint32_t begin = parts[widest].first, n = parts[widest].second;
+         auto range = refs.begin() + (begin - base);
+         int axis = longestCentroidAxis(&*range, n);
+         uint32_t half = n / 2;
+         std::nth_element(range, range + half, range + n,
+                          [axis](const BuildRef& a, const BuildRef& b) { return a.centroid(axis) < b.centroid(axis); });
+         parts[widest] = {begin, half};
+         parts[partCount++] = {begin + half, n - half};
+      }
+
+      for (int c = 0; c < partCount; ++c) {
+         uint32_t begin = parts[c].first, n = parts[c].second;
+         Aabb box = Aabb::empty();
+         for (uint32_t i = begin; i < begin + n; ++i) {
+            const BuildRef& ref = refs[i - base];
+            box.merge({{ref.min[0], ref.min[1], ref.min[2]}, {ref.max[0], ref.max[1], ref.max[2]}});
+         }
+
+         int32_t child = -1;
+         if (n > kLeafSize) child = buildNode(refs, base, begin, n, index, c);
+
+         Node& node = nodes[size_t(index)];
+         setChildBox(node, c, box);
+         node.child[c] = child;
+         node.first[c] = begin;
+         node.count[c] = n;
+         node.builtArea[c] = box.surfaceArea();
+      }
+      return index;
+   }
+
+   static int longestCentroidAxis(const BuildRef* refs, uint32_t count) {
+      float lo[3] = {Aabb::kFar, Aabb::kFar, Aabb::kFar};
+      float hi[3] = {-Aabb::kFar, -Aabb::kFar, -Aabb::kFar};
+      for (uint32_t i = 0; i < count; ++i) {
+         for (int a = 0; a < 3; ++a) {
+            float c = refs[i].centroid(a);
+            lo[a] = std::min(lo[a], c);
+            hi[a] = std::max(hi[a], c);
+         }
+      }
+      int axis = 0;
+      for (int a = 1; a < 3; ++a) {
+         if (hi[a] - lo[a] > hi[axis] - lo[axis]) axis = a;
+      }
+      return axis;
+   }
+
+   // The build sorted the refs; move the object data to match so that every
+   // subtree owns a contiguous slot range, then point the objects at the
+   // leaves built from firstNode on.
+   void applyOrder(const std::vector<BuildRef>& refs, uint32_t offset, size_t firstNode) {
+      if (!refs.empty()) {
+         for (auto& axis : bounds) permute(axis, refs, offset);
+         permute(user, refs, offset);
+         permute(alive, refs, offset);
+         permute(slotToId, refs, offset);
+         // A dead slot's id may already belong to a newer object; only the
+         // live ones still own theirs
+         for (size_t i = 0; i < refs.size(); ++i) {
+            if (alive[offset + i]) idToSlot[slotToId[offset + i]] = uint32_t(offset + i);
+         }
+      }
+      for (size_t n = firstNode; n < nodes.size(); ++n) {
+         const Node& node = nodes[n];
+         for (int c = 0; c < 4; ++c) {
+            if (node.count[c] == 0 || node.child[c] >= 0) continue;
+            for (uint32_t s = node.first[c]; s < node.first[c] + node.count[c]; ++s) leafOf[s] = {int32_t(n), c};
+         }
+      }
+   }
+
+   template <typename T>
+   static void permute(std::vector<T>& data, const std::vector<BuildRef>& refs, uint32_t offset) {
+      std::vector<T> sorted(refs.size());
+      for (size_t i = 0; i < refs.size(); ++i) sorted[i] = data[refs[i].slot];
+      std::copy(sorted.begin(), sorted.end(), data.begin() + offset);
+   }
+
+   // Drops removed objects so slots are dense again
+   void compact() {
+      if (!deadCount) return;
+      uint32_t out = 0;
+      for (uint32_t s = 0; s < slotToId.size(); ++s) {
+         if (!alive[s]) continue;
+         for (auto& axis : bounds) axis[out] = axis[s];
+         user[out] = user[s];
+         slotToId[out] = slotToId[s];
+         idToSlot[slotToId[out]] = out;
+         ++out;
+      }
+      for (auto& axis : bounds) axis.resize(out);
+      user.resize(out);
+      slotToId.resize(out);
+      alive.assign(out, 1);
+      leafOf.assign(out, {-1, 0});
+      deadCount = 0;
+   }
+
+   // Children always have higher indices than their parent, so one backwards
+   // sweep sees every child before the node that holds its box.
+   void refit() {
+      for (size_t n = nodes.size(); n-- > 0;) {
+         if (!dirty[n]) continue;
+         Node& node = nodes[n];
+         for (int c = 0; c < 4; ++c) {
+            if (node.count[c] == 0) continue;
+            Aabb box;
+            if (node.child[c] < 0) {
+               box = rangeBox(node.first[c], node.count[c]);
+            } else {
+               const Node& child = nodes[size_t(node.child[c])];
+               box = Aabb::empty();
+               for (int k = 0; k < 4; ++k) {
+                  if (child.count[k]) box.merge(childBox(child, k));
+               }
+            }
+            setChildBox(node, c, box);
+         }
+         if (node.parent >= 0) dirty[size_t(node.parent)] = 1;
+      }
+   }
+
+   // Walks the dirty part of the tree from the root and rebuilds the topmost
+   // subtrees that have grown too loose: a node child whose box has grown
+   // kRebuildGrowth times, or the node above a leaf that has. The rebuilt
+   // nodes are appended, the old ones abandoned until the next full rebuild.
+   void rebuildDegraded() {
+      std::vector<int32_t> stack = {0};
+      std::vector<std::pair<int32_t, int>> degraded;
+      bool rootDegraded = false;
+      while (!stack.empty()) {
+         int32_t n = stack.back();
+         stack.pop_back();
+         if (!dirty[size_t(n)]) continue;
+         const Node& node = nodes[size_t(n)];
+
+         bool leafGrew = false;
+         for (int c = 0; c < 4 && !leafGrew; ++c) {
+            if (node.count[c] && node.child[c] < 0) leafGrew = grew(node, c);
+         }
+         if (leafGrew) {
+            if (node.parent >= 0) degraded.push_back({node.parent, node.parentSlot});
+            else rootDegraded = true;
+            continue;
+         }
+
+         for (int c = 0; c < 4; ++c) {
+            int32_t child = node.child[c];
+            if (node.count[c] == 0 || child < 0 || !dirty[size_t(child)]) continue;
+            if (grew(node, c)) degraded.push_back({n, c});
+            else stack.push_back(child);
+         }
+      }
+      std::fill(dirty.begin(), dirty.end(), 0);
+
+      if (rootDegraded) {
+         rebuild();
+         return;
+      }
+
+      for (const auto& d : degraded) {
+         const Node& node = nodes[size_t(d.first)];
+         int c = d.second;
+         uint32_t first = node.first[c], count = node.count[c];
+         garbageNodes += countNodes(node.child[c]);
+
+         std::vector<BuildRef> refs = makeRefs(first, count);
+         size_t firstNode = nodes.size();
+         int32_t rebuilt = buildNode(refs, first, first, count, d.first, c);
+         applyOrder(refs, first, firstNode);
+
+         Node& parent = nodes[size_t(d.first)];
+         parent.child[c] = rebuilt;
+         parent.builtArea[c] = childBox(parent, c).surfaceArea();
+      }
+   }
+
+   static bool grew(const Node& node, int c) {
+      return childBox(node, c).surfaceArea() > kRebuildGrowth * node.builtArea[c];
+   }
+
+   size_t countNodes(int32_t root) const {
+      size_t total = 0;
+      std::vector<int32_t> stack = {root};
+      while (!stack.empty()) {
+         const Node& node = nodes[size_t(stack.back())];
+         stack.pop_back();
+         ++total;
+         for (int c = 0; c < 4; ++c) {
+            if (node.count[c] && node.child[c] >= 0) stack.push_back(node.child[c]);
+         }
+      }
+      return total;
+   }
+
+   void emitRange(uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const {
+      if (!deadCount) {
+         visible.insert(visible.end(), user.begin() + first, user.begin() + first + count);
+         return;
+      }
+      for (uint32_t s = first; s < first + count; ++s) {
+         if (alive[s]) visible.push_back(user[s]);
+      }
+   }
+
+   void testObjects(const Frustum& frustum, uint32_t planes, uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const {
+      uint32_t s = first, end = first + count;
+      for (; s + 4 <= end; s += 4) {
+         unsigned outside = testBoxes(frustum, planes, &bounds[0][s], &bounds[1][s], &bounds[2][s],
+                                      &bounds[3][s], &bounds[4][s], &bounds[5][s], nullptr);
+         for (int k = 0; k < 4; ++k) {
+            if (!((outside >> k) & 1u)) visible.push_back(user[s + k]);
+         }
+      }
+      for (; s < end; ++s) {
+         if (!outsideScalar(frustum, planes, objectBox(s))) visible.push_back(user[s]);
+      }
+   }
+
+   static bool outsideScalar(const Frustum& frustum, uint32_t planes, const Aabb& box) {
+      for (int p = 0; p < 6; ++p) {
+         if (!((planes >> p) & 1u)) continue;
+         const float* pl = frustum.planes[p];
+         float d = pl[3];
+         for (int a = 0; a < 3; ++a) d += pl[a] * (pl[a] > 0.0f ? box.max[a] : box.min[a]);
+         if (d < 0.0f) return true;
+      }
+      return false;
+   }
+
+   // Tests four boxes (SoA, four floats per pointer) against the planes in
+   // mask. Returns a bit per box that lies fully outside some plane; for the
+   // rest, planesOut[i] gets the planes box i still straddles (0 = fully
+   // inside, so its subtree needs no further tests). Objects pass nullptr
+   // and skip that half of the work.
+   static unsigned testBoxes(const Frustum& frustum, uint32_t mask,
+                             const float* minX, const float* minY, const float* minZ,
+                             const float* maxX, const float* maxY, const float* maxZ,
+                             uint32_t planesOut[4]) {
+      unsigned outside = 0;
+      if (planesOut) planesOut[0] = planesOut[1] = planesOut[2] = planesOut[3] = 0;
+#if defined(SCENE_BVH_SSE)
+      const __m128 x0 = _mm_loadu_ps(minX), y0 = _mm_loadu_ps(minY), z0 = _mm_loadu_ps(minZ);
+      const __m128 x1 = _mm_loadu_ps(maxX), y1 = _mm_loadu_ps(maxY), z1 = _mm_loadu_ps(maxZ);
+      const __m128 zero = _mm_setzero_ps();
+      for (int p = 0; p < 6; ++p) {
+         if (!((mask >> p) & 1u)) continue;
+         const float* pl = frustum.planes[p];
+         const __m128 a = _mm_set1_ps(pl[0]), b = _mm_set1_ps(pl[1]), c = _mm_set1_ps(pl[2]), d = _mm_set1_ps(pl[3]);
+
+         // Corner furthest along the normal decides "outside", the nearest "inside"
+         __m128 outer = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, pl[0] > 0.0f ? x1 : x0), _mm_mul_ps(b, pl[1] > 0.0f ? y1 : y0)),
+                                 _mm_add_ps(_mm_mul_ps(c, pl[2] > 0.0f ? z1 : z0), d));
+         outside |= unsigned(_mm_movemask_ps(_mm_cmplt_ps(outer, zero)));
+         if (!planesOut) continue;
+         __m128 inner = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, pl[0] > 0.0f ? x0 : x1), _mm_mul_ps(b, pl[1] > 0.0f ? y0 : y1)),
+                                  _mm_add_ps(_mm_mul_ps(c, pl[2] > 0.0f ? z0 : z1), d));
+         unsigned straddle = unsigned(_mm_movemask_ps(_mm_cmplt_ps(inner, zero)));
+         for (int i = 0; i < 4; ++i) {
+            if ((straddle >> i) & 1u) planesOut[i] |= 1u << p;
+         }
+      }
+#else
+      for (int p = 0; p < 6; ++p) {
+         if (!((mask >> p) & 1u)) continue;
+         const float* pl = frustum.planes[p];
+         for (int i = 0; i < 4; ++i) {
+            float outer = pl[0] * (pl[0] > 0.0f ? maxX[i] : minX[i]) + pl[1] * (pl[1] > 0.0f ? maxY[i] : minY[i]) +
+                        pl[2] * (pl[2] > 0.0f ? maxZ[i] : minZ[i]) + pl[3];
+            float inner = pl[0] * (pl[0] > 0.0f ? minX[i] : maxX[i]) + pl[1] * (pl[1] > 0.0f ? minY[i] : maxY[i]) +
+                         pl[2] * (pl[2] > 0.0f ? minZ[i] : maxZ[i]) + pl[3];
+            if (outer < 0.0f) outside |= 1u << i;
+            if (planesOut && inner < 0.0f) planesOut[i] |= 1u << p;
+         }
+      }
+#endif
+      return outside;
+   }
+};
+
+#endif
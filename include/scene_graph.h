@@ -0,0 +1,169 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "scene_bvh.h"
+
+// Transform hierarchy whose nodes carry a local bounding box. update()
+// propagates changed transforms to world space and feeds the resulting world
+// boxes to a SceneBvh, which answers cull() queries.
+//
+// Matrices are column-major float[16], like InstanceData::transform.
+class SceneGraph {
+public:
+   using NodeId = uint32_t;
+   static constexpr NodeId kNone = UINT32_MAX;
+
+   NodeId create(const Aabb& localBounds, uint32_t userData, NodeId parent = kNone) {
+      NodeId id;
+      if (!freeNodes.empty()) {
+         id = freeNodes.back();
+         freeNodes.pop_back();
+      } else {
+         id = NodeId(nodes.size());
+         nodes.emplace_back();
+      }
+
+      Node& node = nodes[id];
+      node = Node();
+      node.localBounds = localBounds;
+      node.parent = parent;
+      node.live = true;
+      if (parent != kNone) {
+         node.nextSibling = nodes[parent].firstChild;
+         nodes[parent].firstChild = id;
+      }
+      node.object = bvh.add(Aabb::empty(), userData);
+      markDirty(id);
+      return id;
+   }
+
+   // Destroys the node and everything below it
+   void destroy(NodeId id) {
+      NodeId parent = nodes[id].parent;
+      if (parent != kNone) {
+         NodeId* link = &nodes[parent].firstChild;
+         while (*link != id) link = &nodes[*link].nextSibling;
+         *link = nodes[id].nextSibling;
+      }
+
+      std::vector<NodeId> stack = {id};
+      while (!stack.empty()) {
+         NodeId n = stack.back();
+         stack.pop_back();
+         for (NodeId c = nodes[n].firstChild; c != kNone; c = nodes[c].nextSibling) stack.push_back(c);
+         bvh.remove(nodes[n].object);
+         nodes[n].live = false;
+         nodes[n].dirty = false;
+         freeNodes.push_back(n);
+      }
+   }
+
+   void setLocalTransform(NodeId id, const float* m) {
+      std::memcpy(nodes[id].local, m, sizeof(nodes[id].local));
+      markDirty(id);
+   }
+
+   void setLocalBounds(NodeId id, const Aabb& box) {
+      nodes[id].localBounds = box;
+      markDirty(id);
+   }
+
+   const float* worldTransform(NodeId id) const { return nodes[id].world; }
+
+   // Recomputes world transforms below every changed node, then refits the BVH
+   void update() {
+      for (NodeId id : dirtyList) {
+         if (!nodes[id].live || !nodes[id].dirty || hasDirtyAncestor(id)) continue;
+         propagate(id);
+      }
+      dirtyList.clear();
+      bvh.update();
+   }
+
+   void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats* stats = nullptr) const {
+      bvh.cull(frustum, visible, stats);
+   }
+
+   const SceneBvh& index() const { return bvh; }
+
+   // Box around a transformed box: centre moves, extents take |m|
+   static Aabb transformBox(const float* m, const Aabb& box) {
+      Aabb out;
+      for (int r = 0; r < 3; ++r) {
+         float centre = m[12 + r];
+         float extent = 0.0f;
+         for (int c = 0; c < 3; ++c) {
+            float mid = 0.5f * (box.min[c] + box.max[c]);
+            float half = 0.5f * (box.max[c] - box.min[c]);
+            centre += m[c * 4 + r] * mid;
+            extent += std::fabs(m[c * 4 + r]) * half;
+         }
+         out.min[r] = centre - extent;
+         out.max[r] = centre + extent;
+      }
+      return out;
+   }
+
+   static void multiply(const float* a, const float* b, float* out) {
+      for (int c = 0; c < 4; ++c) {
+         for (int r = 0; r < 4; ++r) {
+            out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+         }
+      }
+   }
+
+private:
+   struct Node {
+      float local[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+      float world[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+      Aabb localBounds = Aabb::empty();
+      NodeId parent = kNone;
+      NodeId firstChild = kNone;
+      NodeId nextSibling = kNone;
+      SceneBvh::ObjectId object = 0;
+      bool dirty = false;
+      bool live = false;
+   };
+
+   std::vector<Node> nodes;
+   std::vector<NodeId> freeNodes;
+   std::vector<NodeId> dirtyList;
+   SceneBvh bvh;
+
+   void markDirty(NodeId id) {
+      if (nodes[id].dirty) return;
+      nodes[id].dirty = true;
+      dirtyList.push_back(id);
+   }
+
+   bool hasDirtyAncestor(NodeId id) const {
+      for (NodeId p = nodes[id].parent; p != kNone; p = nodes[p].parent) {
+         if (nodes[p].dirty) return true;
+      }
+      return false;
+   }
+
+   void propagate(NodeId root) {
+      std::vector<NodeId>& stack = propagateStack;
+      stack.assign(1, root);
+      while (!stack.empty()) {
+         NodeId id = stack.back();
+         stack.pop_back();
+         Node& node = nodes[id];
+         if (node.parent == kNone) std::memcpy(node.world, node.local, sizeof(node.world));
+         else multiply(nodes[node.parent].world, node.local, node.world);
+         node.dirty = false;
+         bvh.move(node.object, transformBox(node.world, node.localBounds));
+         for (NodeId c = node.firstChild; c != kNone; c = nodes[c].nextSibling) stack.push_back(c);
+      }
+   }
+
+   std::vector<NodeId> propagateStack;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef SDF_GENERATOR_H
+#define SDF_GENERATOR_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "job_system.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SDF_GENERATOR_SSE 1
+#endif
+
+// Builds single-channel signed distance fields from FreeType outlines.
+// Curves are flattened to line segments, then every pixel takes the distance
+// to the nearest segment (four segments per SSE step) and its sign from the
+// nonzero winding rule along its row. Rows are split across the JobSystem.
+//
+// Output is 8-bit: 128 is the outline, 255 is spread pixels inside, 0 is
+// spread pixels outside. One field rendered at a modest size scales to any
+// on-screen size, so a single atlas serves every size and zoom level.
+class SdfGenerator {
+public:
+   struct Field {
+      std::vector<uint8_t> pixels;
+      int width = 0, height = 0;
+      int bearingX = 0, bearingY = 0; // pixels, spread included
+   };
+
+   struct Stats {
+      std::atomic<uint64_t> glyphs{0};
+      std::atomic<uint64_t> segments{0};
+      std::atomic<uint64_t> microseconds{0};
+   };
+
+   SdfGenerator(JobSystem& jobs, int spread = 4) : jobs(jobs), spread(spread) {}
+
+   int getSpread() const { return spread; }
+   const Stats& getStats() const { return stats; }
+
+   // slot must hold an outline glyph (loaded with FT_LOAD_NO_BITMAP).
+   // Returns false for non-outline glyphs; blank glyphs give an empty field.
+   bool generate(FT_GlyphSlot slot, Field& out) {
+      if (slot->format != FT_GLYPH_FORMAT_OUTLINE) return false;
+      auto start = std::chrono::steady_clock::now();
+
+      Segments segments;
+      flatten(slot->outline, segments);
+
+      FT_BBox box;
+      FT_Outline_Get_CBox(&slot->outline, &box);
+      int x0 = int(std::floor(box.xMin / 64.0)), x1 = int(std::ceil(box.xMax / 64.0));
+      int y0 = int(std::floor(box.yMin / 64.0)), y1 = int(std::ceil(box.yMax / 64.0));
+      if (segments.size() == 0 || x1 <= x0 || y1 <= y0) {
+         out = Field();
+         return true;
+      }
+
+      out.bearingX = x0 - spread;
+      out.bearingY = y1 + spread;
+      out.width = x1 - x0 + 2 * spread;
+      out.height = y1 - y0 + 2 * spread;
+      out.pixels.assign(size_t(out.width) * out.height, 0);
+
+      segments.pad();
+      Field& field = out;
+      jobs.parallelFor(size_t(out.height), 4, [this, &segments, &field](size_t begin, size_t end) {
+         std::vector<std::pair<float, int>> crossings;
+         for (size_t row = begin; row < end; ++row) fillRow(segments, field, int(row), crossings);
+      });
+
+      stats.glyphs.fetch_add(1);
+      stats.segments.fetch_add(segments.size());
+      stats.microseconds.fetch_add(uint64_t(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()));
+      return true;
+   }
+
+private:
+   // Line segments, SoA so four at a time load straight into registers
+   struct Segments {
+      std::vector<float> ax, ay, dx, dy, invLengthSq;
+      size_t count = 0;
+
+      size_t size() const { return count; }
+
+      void add(float x0, float y0, float x1, float y1) {
+         float ddx = x1 - x0, ddy = y1 - y0;
+         float lengthSq = ddx * ddx + ddy * ddy;
+         if (lengthSq <= 0.0f) return;
+         ax.push_back(x0);
+         ay.push_back(y0);
+         dx.push_back(ddx);
+         dy.push_back(ddy);
+         invLengthSq.push_back(1.0f / lengthSq);
+         ++count;
+      }
+
+      // Repeats the last segment up to a multiple of four; duplicates don't
+      // change a minimum
+      void pad() {
+         while (ax.size() % 4) {
+            ax.push_back(ax.back());
+            ay.push_back(ay.back());
+            dx.push_back(dx.back());
+            dy.push_back(dy.back());
+            invLengthSq.push_back(invLengthSq.back());
+         }
+      }
+   };
+
+   struct FlattenState {
+      Segments* out;
+      float x, y;
+   };
+
+   JobSystem& jobs;
+   int spread;
+   Stats stats;
+
+   // Chord error stays under about a tenth of a pixel
+   static constexpr float kTolerance = 0.1f;
+
+   static int steps(float deviation) {
+      return std::max(1, std::min(64, int(std::ceil(std::sqrt(deviation / kTolerance)))));
+   }
+
+   static void flatten(const FT_Outline& outline, Segments& segments) {
+      FT_Outline_Funcs funcs = {};
+      funcs.move_to = [](const FT_Vector* to, void* user) -> int {
+         auto* s = static_cast<FlattenState*>(user);
+         s->x = float(to->x) / 64.0f;
+         s->y = float(to->y) / 64.0f;
+         return 0;
+      };
+      funcs.line_to = [](const FT_Vector* to, void* user) -> int {
+         auto* s = static_cast<FlattenState*>(user);
+         float x = float(to->x) / 64.0f, y = float(to->y) / 64.0f;
+         s->out->add(s->x, s->y, x, y);
+         s->x = x;
+         s->y = y;
+         return 0;
+      };
+      funcs.conic_to = [](const FT_Vector* control, const FT_Vector* to, void* user) -> int {
+         auto* s = static_cast<FlattenState*>(user);
+         float cx = float(control->x) / 64.0f, cy = float(control->y) / 64.0f;
+         float x = float(to->x) / 64.0f, y = float(to->y) / 64.0f;
+         int n = steps(0.25f * std::hypot(s->x - 2.0f * cx + x, s->y - 2.0f * cy + y));
+         float px = s->x, py = s->y;
+         for (int i = 1; i <= n; ++i) {
+            float t = float(i) / float(n), u = 1.0f - t;
+            float qx = u * u * s->x + 2.0f * u * t * cx + t * t * x;
+            float qy = u * u * s->y + 2.0f * u * t * cy + t * t * y;
+            s->out->add(px, py, qx, qy);
+            px = qx;
+            py = qy;
+         }
+         s->x = x;
+         s->y = y;
+         return 0;
+      };
+      funcs.cubic_to = [](const FT_Vector* c1, const FT_Vector* c2, const FT_Vector* to, void* user) -> int {
+         auto* s = static_cast<FlattenState*>(user);
+         float ax = float(c1->x) / 64.0f, ay = float(c1->y) / 64.0f;
+         float bx = float(c2->x) / 64.0f, by = float(c2->y) / 64.0f;
+         float x = float(to->x) / 64.0f, y = float(to->y) / 64.0f;
+         float d = std::max(std::hypot(s->x - 2.0f * ax + bx, s->y - 2.0f * ay + by), std::hypot(ax - 2.0f * bx + x, ay - 2.0f * by + y));
+         int n = steps(0.75f * d);
+         float px = s->x, py = s->y;
+         for (int i = 1; i <= n; ++i) {
+            float t = float(i) / float(n), u = 1.0f - t;
+            float qx = u * u * u * s->x + 3.0f * u * u * t * ax + 3.0f * u * t * t * bx + t * t * t * x;
+            float qy = u * u * u * s->y + 3.0f * u * u * t * ay + 3.0f * u * t * t * by + t * t * t * y;
+            s->out->add(px, py, qx, qy);
+            px = qx;
+            py = qy;
+         }
+         s->x = x;
+         s->y = y;
+         return 0;
+      };
+
+      // Decompose closes every contour with a final line_to
+      FlattenState state{&segments, 0.0f, 0.0f};
+      FT_Outline_Decompose(const_cast<FT_Outline*>(&outline), &funcs, &state);
+   }
+
+   void fillRow(const Segments& segments, Field& field, int row, std::vector<std::pair<float, int>>& crossings) const {
+      float py = float(field.bearingY) - float(row) - 0.5f;
+
+      // Where the row's sample line crosses the outline, and which way
+      crossings.clear();
+      for (size_t i = 0; i < segments.size(); ++i) {
+         float y0 = segments.ay[i], y1 = y0 + segments.dy[i];
+         if ((y0 <= py) == (y1 <= py)) continue;
+         float t = (py - y0) / segments.dy[i];
+         crossings.push_back({segments.ax[i] + t * segments.dx[i], y1 > y0 ? 1 : -1});
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      uint8_t* out = field.pixels.data() + size_t(row) * field.width;
+      size_t next = 0;
+      int winding = 0;
+      const float scale = 127.0f / float(spread);
+      for (int col = 0; col < field.width; ++col) {
+         float px = float(field.bearingX) + float(col) + 0.5f;
+         while (next < crossings.size() && crossings[next].first < px) winding += crossings[next++].second;
+
+         float distance = std::sqrt(nearestSq(segments, px, py));
+         float value = 128.0f + (winding != 0 ? distance : -distance) * scale;
+         out[col] = uint8_t(std::min(255.0f, std::max(0.0f, value + 0.5f)));
+      }
+   }
+
+   // Squared distance from (px, py) to the closest segment
+   static float nearestSq(const Segments& s, float px, float py) {
+      size_t padded = s.ax.size();
+#if defined(SDF_GENERATOR_SSE)
+      const __m128 x = _mm_set1_ps(px), y = _mm_set1_ps(py);
+      const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+      __m128 best = _mm_set1_ps(1e30f);
+      for (size_t i = 0; i < padded; i += 4) {
+         __m128 ax = _mm_loadu_ps(&s.ax[i]), ay = _mm_loadu_ps(&s.ay[i]);
+         __m128 dx = _mm_loadu_ps(&s.dx[i]), dy = _mm_loadu_ps(&s.dy[i]);
+         __m128 rx = _mm_sub_ps(x, ax), ry = _mm_sub_ps(y, ay);
+         __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(rx, dx), _mm_mul_ps(ry, dy)), _mm_loadu_ps(&s.invLengthSq[i]));
+         t = _mm_min_ps(one, _mm_max_ps(zero, t));
+         __m128 ex = _mm_sub_ps(rx, _mm_mul_ps(t, dx)), ey = _mm_sub_ps(ry, _mm_mul_ps(t, dy));
+         best = _mm_min_ps(best, _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+      }
+      best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+      best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(best);
+#else
+      float best = 1e30f;
+      for (size_t i = 0; i < padded; ++i) {
+         float rx = px - s.ax[i], ry = py - s.ay[i];
+         float t = std::min(1.0f, std::max(0.0f, (rx * s.dx[i] + ry * s.dy[i]) * s.invLengthSq[i]));
+         float ex = rx - t * s.dx[i], ey = ry - t * s.dy[i];
+         best = std::min(best, ex * ex + ey * ey);
+      }
+      return best;
+#endif
+   }
+};
+
+#endif
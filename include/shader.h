@@ -72,6 +72,12 @@ public:
         glDeleteShader(fragment);
     }
 
+    // wraps a program that was already linked elsewhere (e.g. by ShaderCompiler)
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int programId) : ID(programId)
+    {
+    }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
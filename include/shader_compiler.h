@@ -0,0 +1,381 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Compiles shader programs without stalling on the driver.
+//
+// Every program is submitted up front and its status is only queried the
+// first time it is needed. When the driver exposes KHR/ARB parallel shader
+// compile, compilation runs on the driver's own threads; otherwise a worker
+// thread owning a context shared with the main window compiles in the
+// background. Without either the work is deferred to the first program() call.
+class ShaderCompiler {
+public:
+   using Handle = size_t;
+
+   // workerContext is an optional hidden window sharing objects with the
+   // render context (see NativeWindowManager::createSharedContext).
+   explicit ShaderCompiler(GLFWwindow* workerContext = nullptr)
+   : workerContext(workerContext) {
+      if (GLAD_GL_KHR_parallel_shader_compile) {
+         glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+         driverParallel = true;
+      } else if (GLAD_GL_ARB_parallel_shader_compile) {
+         glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+         driverParallel = true;
+      }
+
+      if (!driverParallel && workerContext) {
+         worker = std::thread(&ShaderCompiler::workerLoop, this);
+      }
+   }
+
+   ~ShaderCompiler() {
+      if (worker.joinable()) {
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+         }
+         queueCv.notify_all();
+         worker.join();
+      }
+      for (auto& r : reloads) {
+         deleteShaders(*r.program);
+         if (r.program->id) glDeleteProgram(r.program->id);
+      }
+      for (auto& p : programs) {
+         deleteShaders(*p);
+         if (p->id) glDeleteProgram(p->id);
+      }
+   }
+
+   ShaderCompiler(const ShaderCompiler&) = delete;
+   ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+   // Reads the sources and queues the program for compilation. Never blocks on GL.
+   Handle submit(const std::string& vertexPath, const std::string& fragmentPath) {
+      auto p = std::make_unique<Program>();
+      p->vertexPath = vertexPath;
+      p->fragmentPath = fragmentPath;
+      if (!readFile(vertexPath, p->vertexCode) || !readFile(fragmentPath, p->fragmentCode)) {
+         p->state = State::Checked;
+      }
+
+      Program* raw = p.get();
+      Handle handle;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         handle = programs.size();
+         programs.push_back(std::move(p));
+      }
+
+      if (raw->state == State::Pending) dispatch(*raw);
+      return handle;
+   }
+
+   // Same as submit() for sources embedded in the binary. label only appears in
+   // error messages; such programs have no files to hot reload.
+   Handle submitSource(const std::string& label, std::string vertexCode, std::string fragmentCode) {
+      auto p = std::make_unique<Program>();
+      p->vertexPath = label;
+      p->fragmentPath = label;
+      p->vertexCode = std::move(vertexCode);
+      p->fragmentCode = std::move(fragmentCode);
+
+      Program* raw = p.get();
+      Handle handle;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         handle = programs.size();
+         programs.push_back(std::move(p));
+      }
+
+      dispatch(*raw);
+      return handle;
+   }
+
+   // Non-blocking: true once program() can return without waiting on the driver.
+   bool isReady(Handle handle) { return ready(get(handle)); }
+
+   // Returns the linked program id, or 0 if compilation failed. The first call
+   // for a handle waits for the result and reports any errors.
+   GLuint program(Handle handle) {
+      Program& p = get(handle);
+      if (stateOf(p) == State::Checked) return p.linked ? p.id : 0;
+      return settle(p) ? p.id : 0;
+   }
+
+   // Queues a background recompile of an existing program from new sources.
+   // The current program stays in use until commitReloads() swaps it out.
+   void reload(Handle handle, std::string vertexCode, std::string fragmentCode) {
+      Program& current = get(handle);
+      program(handle);
+
+      auto next = std::make_unique<Program>();
+      next->vertexPath = current.vertexPath;
+      next->fragmentPath = current.fragmentPath;
+      next->vertexCode = std::move(vertexCode);
+      next->fragmentCode = std::move(fragmentCode);
+
+      // A newer edit supersedes a reload that has not been committed yet.
+      for (auto& r : reloads) {
+         if (r.handle == handle) r.superseded = true;
+      }
+
+      Program* raw = next.get();
+      reloads.push_back({handle, std::move(next), false});
+      dispatch(*raw);
+   }
+
+   // Call once per frame from the render thread, between frames. Swaps in every
+   // finished reload; a reload that fails to compile leaves the old program
+   // bound. Returns the number of programs replaced.
+   size_t commitReloads() {
+      size_t swapped = 0;
+      for (auto it = reloads.begin(); it != reloads.end();) {
+         Program& next = *it->program;
+         // With no background path at all, settle() below compiles inline.
+         bool async = driverParallel || worker.joinable();
+         if (async && !ready(next)) {
+            ++it;
+            continue;
+         }
+
+         Program& current = get(it->handle);
+         if (it->superseded) {
+            settleQuietly(next);
+         } else if (settle(next)) {
+            if (current.id) glDeleteProgram(current.id);
+            current.id = next.id;
+            current.linked = true;
+            next.id = 0;
+            ++swapped;
+            std::cout << "SHADER::RELOADED: " << current.vertexPath << " + " << current.fragmentPath << std::endl;
+         } else {
+            std::cout << "SHADER::RELOAD_FAILED, keeping previous program: " << current.fragmentPath << std::endl;
+         }
+
+         if (next.id) glDeleteProgram(next.id);
+         it = reloads.erase(it);
+      }
+      return swapped;
+   }
+
+   const std::string& vertexPath(Handle handle) { return get(handle).vertexPath; }
+   const std::string& fragmentPath(Handle handle) { return get(handle).fragmentPath; }
+
+   // Waits for every submitted program, e.g. at the end of a loading screen.
+   void finishAll() {
+      size_t count;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         count = programs.size();
+      }
+      for (Handle h = 0; h < count; ++h) program(h);
+   }
+
+   bool usesDriverParallelCompile() const { return driverParallel; }
+   bool usesWorkerThread() const { return worker.joinable(); }
+
+private:
+   enum class State { Pending, Issued, Finished, Checked };
+
+   struct Program {
+      std::string vertexPath;
+      std::string fragmentPath;
+      std::string vertexCode;
+      std::string fragmentCode;
+      std::string log;
+      GLuint vertex = 0;
+      GLuint fragment = 0;
+      GLuint id = 0;
+      bool linked = false;
+      State state = State::Pending;
+   };
+
+   struct Reload {
+      Handle handle;
+      std::unique_ptr<Program> program;
+      bool superseded;
+   };
+
+   GLFWwindow* workerContext;
+   bool driverParallel = false;
+
+   std::deque<std::unique_ptr<Program>> programs;
+   std::deque<Program*> queue;
+   std::deque<Reload> reloads;
+   std::mutex mutex;
+   std::condition_variable queueCv;
+   std::condition_variable doneCv;
+   std::thread worker;
+   bool stopping = false;
+
+   Program& get(Handle handle) {
+      std::lock_guard<std::mutex> lock(mutex);
+      return *programs.at(handle);
+   }
+
+   State stateOf(Program& p) {
+      std::lock_guard<std::mutex> lock(mutex);
+      return p.state;
+   }
+
+   bool ready(Program& p) {
+      State state = stateOf(p);
+      if (state == State::Checked || state == State::Finished) return true;
+      if (state == State::Issued && driverParallel) {
+         GLint done = GL_FALSE;
+         glGetProgramiv(p.id, GL_COMPLETION_STATUS_KHR, &done);
+         return done == GL_TRUE;
+      }
+      return false;
+   }
+
+   // Waits for the program if needed and reports errors; true if it linked.
+   bool settle(Program& p) {
+      if (!settleQuietly(p)) {
+         std::cout << "ERROR::SHADER_COMPILER: " << p.vertexPath << " + " << p.fragmentPath
+                   << "\n" << p.log << "\n -- --------------------------------------------------- -- " << std::endl;
+         return false;
+      }
+      return true;
+   }
+
+   bool settleQuietly(Program& p) {
+      State state = stateOf(p);
+      if (state == State::Checked) return p.linked;
+
+      if (state == State::Pending) {
+         if (worker.joinable()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCv.wait(lock, [&p] { return p.state == State::Finished; });
+         } else {
+            issue(p);
+            p.state = State::Issued;
+         }
+      }
+
+      // Worker-compiled programs already carry their status.
+      if (p.state == State::Issued) collectStatus(p);
+      p.state = State::Checked;
+      return p.linked;
+   }
+
+   void dispatch(Program& p) {
+      if (driverParallel) {
+         issue(p);
+         p.state = State::Issued;
+      } else if (worker.joinable()) {
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(&p);
+         }
+         queueCv.notify_one();
+      }
+      // Otherwise stay Pending until first use.
+   }
+
+   // Issues compile + link without any status query so the driver can pipeline.
+   void issue(Program& p) {
+      const char* vCode = p.vertexCode.c_str();
+      const char* fCode = p.fragmentCode.c_str();
+
+      p.vertex = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(p.vertex, 1, &vCode, NULL);
+      glCompileShader(p.vertex);
+
+      p.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(p.fragment, 1, &fCode, NULL);
+      glCompileShader(p.fragment);
+
+      p.id = glCreateProgram();
+      glAttachShader(p.id, p.vertex);
+      glAttachShader(p.id, p.fragment);
+      glLinkProgram(p.id);
+   }
+
+   void collectStatus(Program& p) {
+      GLint success = GL_FALSE;
+      char infoLog[1024];
+
+      glGetProgramiv(p.id, GL_LINK_STATUS, &success);
+      p.linked = success == GL_TRUE;
+
+      if (!p.linked) {
+         glGetShaderiv(p.vertex, GL_COMPILE_STATUS, &success);
+         if (!success) {
+            glGetShaderInfoLog(p.vertex, sizeof(infoLog), NULL, infoLog);
+            p.log += std::string("VERTEX: ") + infoLog;
+         }
+         glGetShaderiv(p.fragment, GL_COMPILE_STATUS, &success);
+         if (!success) {
+            glGetShaderInfoLog(p.fragment, sizeof(infoLog), NULL, infoLog);
+            p.log += std::string("FRAGMENT: ") + infoLog;
+         }
+         glGetProgramInfoLog(p.id, sizeof(infoLog), NULL, infoLog);
+         p.log += std::string("PROGRAM: ") + infoLog;
+      }
+      deleteShaders(p);
+   }
+
+   void deleteShaders(Program& p) {
+      if (p.vertex) glDeleteShader(p.vertex);
+      if (p.fragment) glDeleteShader(p.fragment);
+      p.vertex = p.fragment = 0;
+   }
+
+   void workerLoop() {
+      glfwMakeContextCurrent(workerContext);
+
+      for (;;) {
+         Program* p;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) break;
+            p = queue.front();
+            queue.pop_front();
+         }
+
+         issue(*p);
+         collectStatus(*p);
+         // Objects must be complete before another context in the share group uses them.
+         glFinish();
+
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            p->state = State::Finished;
+         }
+         doneCv.notify_all();
+      }
+
+      glfwMakeContextCurrent(nullptr);
+   }
+
+   static bool readFile(const std::string& path, std::string& out) {
+      std::ifstream file(path);
+      if (!file) {
+         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+         return false;
+      }
+      std::stringstream stream;
+      stream << file.rdbuf();
+      out = stream.str();
+      return true;
+   }
+};
+
+#endif
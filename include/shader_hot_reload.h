@@ -0,0 +1,153 @@
+#ifndef SHADER_HOT_RELOAD_H
+#define SHADER_HOT_RELOAD_H
+
+#include "shader_compiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches the sources of ShaderCompiler programs and recompiles them in the
+// background when they change on disk. Sources are read on the watcher
+// thread; the swap happens in update(), which the render loop calls once per
+// frame so a program never changes in the middle of a frame.
+//
+// update() also takes the last frame time so the cost of an edited shader is
+// visible right away: after each swap the average frame time before and after
+// the change is printed.
+class ShaderHotReloader {
+public:
+   explicit ShaderHotReloader(ShaderCompiler& compiler,
+                              std::chrono::milliseconds pollInterval = std::chrono::milliseconds(250))
+   : compiler(compiler), pollInterval(pollInterval) {}
+
+   ~ShaderHotReloader() { stop(); }
+
+   ShaderHotReloader(const ShaderHotReloader&) = delete;
+   ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+   void watch(ShaderCompiler::Handle handle) {
+      std::lock_guard<std::mutex> lock(mutex);
+      Watched w;
+      w.handle = handle;
+      w.vertexPath = compiler.vertexPath(handle);
+      w.fragmentPath = compiler.fragmentPath(handle);
+      w.vertexTime = modifiedTime(w.vertexPath);
+      w.fragmentTime = modifiedTime(w.fragmentPath);
+      watched.push_back(std::move(w));
+   }
+
+   void start() {
+      if (watcher.joinable()) return;
+      running = true;
+      watcher = std::thread(&ShaderHotReloader::watchLoop, this);
+   }
+
+   void stop() {
+      running = false;
+      if (watcher.joinable()) watcher.join();
+   }
+
+   // Render thread, at a frame boundary. frameMs is the duration of the frame
+   // that just finished.
+   void update(double frameMs) {
+      averageFrameMs = averageFrameMs == 0.0 ? frameMs : averageFrameMs * 0.95 + frameMs * 0.05;
+
+      std::vector<Changed> ready;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         ready.swap(changed);
+      }
+      for (auto& c : ready) {
+         compiler.reload(c.handle, std::move(c.vertexCode), std::move(c.fragmentCode));
+      }
+
+      if (compiler.commitReloads() > 0) {
+         msBeforeSwap = averageFrameMs;
+         framesSinceSwap = 0;
+      }
+
+      if (framesSinceSwap >= 0 && ++framesSinceSwap == kReportAfterFrames) {
+         std::cout << "SHADER::FRAME_TIME: " << msBeforeSwap << " ms before reload, "
+                   << averageFrameMs << " ms after" << std::endl;
+         framesSinceSwap = -1;
+      }
+   }
+
+   double averageFrameTime() const { return averageFrameMs; }
+
+private:
+   static constexpr int kReportAfterFrames = 120;
+
+   struct Watched {
+      ShaderCompiler::Handle handle;
+      std::string vertexPath;
+      std::string fragmentPath;
+      std::filesystem::file_time_type vertexTime;
+      std::filesystem::file_time_type fragmentTime;
+   };
+
+   struct Changed {
+      ShaderCompiler::Handle handle;
+      std::string vertexCode;
+      std::string fragmentCode;
+   };
+
+   ShaderCompiler& compiler;
+   std::chrono::milliseconds pollInterval;
+   std::vector<Watched> watched;
+   std::vector<Changed> changed;
+   std::mutex mutex;
+   std::thread watcher;
+   std::atomic<bool> running{false};
+
+   double averageFrameMs = 0.0;
+   double msBeforeSwap = 0.0;
+   int framesSinceSwap = -1;
+
+   void watchLoop() {
+      while (running) {
+         std::this_thread::sleep_for(pollInterval);
+
+         std::lock_guard<std::mutex> lock(mutex);
+         for (auto& w : watched) {
+            auto vTime = modifiedTime(w.vertexPath);
+            auto fTime = modifiedTime(w.fragmentPath);
+            if (vTime == w.vertexTime && fTime == w.fragmentTime) continue;
+
+            // Editors that save via rename can leave the file briefly missing.
+            Changed c;
+            c.handle = w.handle;
+            if (!readFile(w.vertexPath, c.vertexCode) || !readFile(w.fragmentPath, c.fragmentCode)) continue;
+
+            w.vertexTime = vTime;
+            w.fragmentTime = fTime;
+            changed.push_back(std::move(c));
+         }
+      }
+   }
+
+   static std::filesystem::file_time_type modifiedTime(const std::string& path) {
+      std::error_code ec;
+      auto time = std::filesystem::last_write_time(path, ec);
+      return ec ? std::filesystem::file_time_type::min() : time;
+   }
+
+   static bool readFile(const std::string& path, std::string& out) {
+      std::ifstream file(path);
+      if (!file) return false;
+      std::stringstream stream;
+      stream << file.rdbuf();
+      out = stream.str();
+      return !out.empty();
+   }
+};
+
+#endif
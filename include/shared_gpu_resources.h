@@ -0,0 +1,194 @@
+#ifndef SHARED_GPU_RESOURCES_H
+#define SHARED_GPU_RESOURCES_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#if defined(ENIGMA_HAS_GLX)
+#define GLFW_EXPOSE_NATIVE_GLX
+#include <GLFW/glfw3native.h>
+#endif
+
+#include <QOpenGLContext>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "gl_state_cache.h"
+
+#if defined(ENIGMA_HAS_GLX)
+// Exported by QtGui but only declared in its private headers. QOpenGLWidget
+// (through the window's RHI context) shares with whatever is set here.
+Q_GUI_EXPORT void qt_gl_set_global_share_context(QOpenGLContext* context);
+#endif
+
+// Buffers, textures and programs that the GLFW window and the Qt widget both
+// draw with. Everything is created once, in the GLFW context, and looked up by
+// key; the Qt side reuses the same object names when its context is in the
+// same share group, so data like the WASM vertex buffer is uploaded once.
+//
+// Only shareable objects live here. VAOs, framebuffers and query objects are
+// per-context in GL, so each front end still builds its own VAO over these
+// buffers. Binds go through the GLStateCache of whichever context is current.
+class SharedGpuResources {
+public:
+   struct Stats {
+      size_t created = 0;
+      size_t reused = 0;
+      uint64_t bytesUploaded = 0;
+   };
+
+   ~SharedGpuResources() {
+      if (!objects.empty()) std::cerr << "SharedGpuResources: release() was not called, leaking GL objects" << std::endl;
+   }
+
+   // Wraps the GLFW context in a QOpenGLContext and makes it Qt's global share
+   // context. Call once, with the GLFW context current, before any
+   // QOpenGLWidget is shown. Returns false when the platform can't adopt a
+   // native context (non-GLX builds, Wayland/EGL Qt); callers then fall back
+   // to per-context uploads, see visibleFrom().
+   bool shareWithQt(GLFWwindow* window) {
+#if defined(ENIGMA_HAS_GLX) && QT_CONFIG(xcb_glx_plugin)
+      if (qtShare) return true;
+      qtShare = QNativeInterface::QGLXContext::fromNative(glfwGetGLXContext(window));
+      if (!qtShare) {
+         std::cerr << "SharedGpuResources: Qt could not adopt the GLFW context" << std::endl;
+         return false;
+      }
+      qt_gl_set_global_share_context(qtShare);
+      return true;
+#else
+      (void)window;
+      return false;
+#endif
+   }
+
+   // True when objects created here can be used from the given Qt context
+   bool visibleFrom(QOpenGLContext* context) const {
+      return qtShare && context && QOpenGLContext::areSharing(context, qtShare);
+   }
+
+   // The buffer stored under key, created and filled on first use. Later
+   // calls return the same name without uploading; use updateBuffer() to
+   // change the contents.
+   GLuint buffer(GLStateCache& state, const std::string& key, GLenum target, const void* data, size_t bytes, GLenum usage) {
+      auto it = objects.find(key);
+      if (it != objects.end()) {
+         ++stats.reused;
+         return it->second.id;
+      }
+
+      Object object{Kind::Buffer, 0, target, bytes};
+      glGenBuffers(1, &object.id);
+      state.bindBuffer(target, object.id);
+      glBufferData(target, GLsizeiptr(bytes), data, usage);
+      stats.bytesUploaded += bytes;
+      ++stats.created;
+      publish();
+      objects.emplace(key, object);
+      return object.id;
+   }
+
+   // Replaces the contents of an existing buffer from whichever context is
+   // current. The other context sees the new data the next time it binds the
+   // buffer.
+   bool updateBuffer(GLStateCache& state, const std::string& key, const void* data, size_t bytes) {
+      auto it = objects.find(key);
+      if (it == objects.end() || it->second.kind != Kind::Buffer) return false;
+
+      Object& object = it->second;
+      state.bindBuffer(object.target, object.id);
+      if (bytes > object.bytes) {
+         glBufferData(object.target, GLsizeiptr(bytes), data, GL_DYNAMIC_DRAW);
+         object.bytes = bytes;
+      } else {
+         glBufferSubData(object.target, 0, GLsizeiptr(bytes), data);
+      }
+      stats.bytesUploaded += bytes;
+      publish();
+      return true;
+   }
+
+   // RGBA8 2D texture under key, created on first use
+   GLuint texture(GLStateCache& state, const std::string& key, int width, int height, const void* pixels) {
+      auto it = objects.find(key);
+      if (it != objects.end()) {
+         ++stats.reused;
+         return it->second.id;
+      }
+
+      Object object{Kind::Texture, 0, GL_TEXTURE_2D, size_t(width) * height * 4};
+      glGenTextures(1, &object.id);
+      state.bindTexture(0, GL_TEXTURE_2D, object.id);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+      stats.bytesUploaded += object.bytes;
+      ++stats.created;
+      publish();
+      objects.emplace(key, object);
+      return object.id;
+   }
+
+   // Registers a program linked elsewhere (e.g. by ShaderCompiler) so the
+   // other front end can look it up instead of compiling its own copy.
+   // Ownership moves here.
+   void adoptProgram(const std::string& key, GLuint program) {
+      objects[key] = Object{Kind::Program, program, 0, 0};
+   }
+
+   // 0 when nothing is stored under key
+   GLuint find(const std::string& key) const {
+      auto it = objects.find(key);
+      return it == objects.end() ? 0 : it->second.id;
+   }
+
+   const Stats& getStats() const { return stats; }
+
+   // Deletes everything; a context of the share group must be current.
+   void release(GLStateCache& state) {
+      for (auto& entry : objects) {
+         const Object& object = entry.second;
+         switch (object.kind) {
+            case Kind::Buffer:
+               state.forgetBuffer(object.id);
+               glDeleteBuffers(1, &object.id);
+               break;
+            case Kind::Texture:
+               state.forgetTexture(object.id);
+               glDeleteTextures(1, &object.id);
+               break;
+            case Kind::Program:
+               state.forgetProgram(object.id);
+               glDeleteProgram(object.id);
+               break;
+         }
+      }
+      objects.clear();
+   }
+
+private:
+   enum class Kind { Buffer, Texture, Program };
+
+   struct Object {
+      Kind kind;
+      GLuint id;
+      GLenum target;
+      size_t bytes;
+   };
+
+   std::unordered_map<std::string, Object> objects;
+   QOpenGLContext* qtShare = nullptr;
+   Stats stats;
+
+   // Objects changed in one context are only guaranteed visible to another
+   // after the commands are flushed and the object is bound there again.
+   static void publish() { glFlush(); }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "font_engine.h"
+
+// Lays out paragraphs of UTF-8 text (greedy word wrap, kerning, '\n' breaks)
+// and keeps the result. Paragraphs are cached by their content hash, wrap
+// width, font and size, so text that didn't change since last frame costs a
+// hash and a compare instead of a walk through the font tables. Entries not
+// used for kMaxAge frames are dropped by beginFrame().
+//
+// The glyph positions come out relative to the paragraph's first baseline;
+// TextRenderer::addParagraph() turns them into quads without re-reading the
+// text.
+class TextLayout {
+public:
+   // A glyph placed relative to the paragraph origin. Spaces and other
+   // blank codepoints only move the pen and aren't stored.
+   struct PlacedGlyph {
+      uint32_t codepoint;
+      float x, y;
+   };
+
+   struct Paragraph {
+      const FontEngine* font = nullptr;
+      float size = 0.0f; // 0 = bitmap glyphs, as in TextRenderer::addText()
+      std::vector<PlacedGlyph> glyphs;
+      float width = 0.0f;  // widest line
+      float height = 0.0f; // lines * line height
+      int lines = 0;
+   };
+
+   struct Stats {
+      size_t hits = 0;
+      size_t misses = 0; // paragraphs laid out this frame
+      size_t evicted = 0;
+      size_t cached = 0;
+   };
+
+   // Frames a paragraph may go unused before beginFrame() drops it
+   static constexpr uint64_t kMaxAge = 120;
+
+   // Starts a frame: resets the per-frame stats and, every so often, drops
+   // paragraphs that haven't been asked for recently
+   void beginFrame() {
+      ++frame;
+      stats.hits = stats.misses = stats.evicted = 0;
+      if (frame % 32 == 0) {
+         for (auto it = cache.begin(); it != cache.end();) {
+            if (frame - it->second.lastUsed > kMaxAge) {
+               it = cache.erase(it);
+               ++stats.evicted;
+            } else {
+               ++it;
+            }
+         }
+      }
+      stats.cached = cache.size();
+   }
+
+   // The laid-out paragraph for text, reusing last frame's layout when
+   // nothing changed. wrapWidth <= 0 never wraps. The reference stays valid
+   // until the next beginFrame() or clear().
+   const Paragraph& layout(const FontEngine& font, std::string_view text, float wrapWidth = 0.0f, float size = 0.0f) {
+      Key key{std::hash<std::string_view>()(text), &font, size, wrapWidth > 0.0f ? wrapWidth : 0.0f};
+      Entry& entry = cache[key];
+      entry.lastUsed = frame;
+      // Equal hashes almost always mean equal text; the compare makes sure
+      if (entry.paragraph.font == &font && entry.text == text) {
+         ++stats.hits;
+         return entry.paragraph;
+      }
+
+      ++stats.misses;
+      entry.text.assign(text.data(), text.size());
+      build(font, text, key.wrapWidth, size, entry.paragraph);
+      stats.cached = cache.size();
+      return entry.paragraph;
+   }
+
+   void clear() {
+      cache.clear();
+      stats.cached = 0;
+   }
+
+   const Stats& getStats() const { return stats; }
+
+private:
+   struct Key {
+      size_t textHash;
+      const FontEngine* font;
+      float size;
+      float wrapWidth;
+
+      bool operator==(const Key& other) const {
+         return textHash == other.textHash && font == other.font && size == other.size && wrapWidth == other.wrapWidth;
+      }
+   };
+
+   struct KeyHash {
+      size_t operator()(const Key& k) const {
+         size_t h = k.textHash;
+         h ^= std::hash<const void*>()(k.font) + 0x9e3779b9 + (h << 6) + (h >> 2);
+         h ^= std::hash<float>()(k.size) + 0x9e3779b9 + (h << 6) + (h >> 2);
+         h ^= std::hash<float>()(k.wrapWidth) + 0x9e3779b9 + (h << 6) + (h >> 2);
+         return h;
+      }
+   };
+
+   struct Entry {
+      std::string text;
+      Paragraph paragraph;
+      uint64_t lastUsed = 0;
+   };
+
+   std::unordered_map<Key, Entry, KeyHash> cache;
+   uint64_t frame = 0;
+   Stats stats;
+
+   static bool isSpace(uint32_t codepoint) { return codepoint == ' ' || codepoint == '\t' || codepoint == 0xA0; }
+
+   // Greedy wrap: a line breaks after its last space once the next glyph
+   // would cross wrapWidth, or mid-word when a word alone is too wide.
+   // Spaces at the end of a line may hang past the edge.
+   static void build(const FontEngine& font, std::string_view text, float wrapWidth, float size, Paragraph& out) {
+      out.font = &font;
+      out.size = size;
+      out.glyphs.clear();
+      out.width = 0.0f;
+      const float lineHeight = font.lineHeight(size);
+
+      float penX = 0.0f, penY = 0.0f;
+      size_t lineStart = 0;   // first glyph of the current line
+      size_t breakGlyph = 0;  // first glyph after the last space on this line
+      float breakX = -1.0f;   // pen after that space; < 0 when there is none
+      uint32_t previous = 0;
+      int lines = 1;
+
+      auto newLine = [&](float lineWidth) {
+         out.width = std::max(out.width, lineWidth);
+         penY += lineHeight;
+         ++lines;
+         lineStart = out.glyphs.size();
+         breakX = -1.0f;
+         previous = 0;
+      };
+
+      const char* p = text.data();
+      const char* end = p + text.size();
+      while (p < end) {
+         uint32_t codepoint = FontEngine::decodeUtf8(p, end);
+         if (codepoint == '\n') {
+            newLine(penX);
+            penX = 0.0f;
+            continue;
+         }
+         if (previous) penX += font.kerning(previous, codepoint, size);
+         previous = codepoint;
+         const float advance = font.advance(codepoint, size);
+
+         if (isSpace(codepoint)) {
+            penX += advance;
+            breakGlyph = out.glyphs.size();
+            breakX = penX;
+            continue;
+         }
+
+         if (wrapWidth > 0.0f && penX + advance > wrapWidth && out.glyphs.size() > lineStart) {
+            if (breakX >= 0.0f && breakGlyph > lineStart) {
+               // Carry the word after the last space down to the next line;
+               // the trailing spaces don't count towards the line's width
+               const PlacedGlyph& last = out.glyphs[breakGlyph - 1];
+               const size_t carried = breakGlyph;
+               const float shift = breakX;
+               newLine(last.x + font.advance(last.codepoint, size));
+               lineStart = carried;
+               for (size_t i = carried; i < out.glyphs.size(); ++i) {
+                  out.glyphs[i].x -= shift;
+                  out.glyphs[i].y = penY;
+               }
+               penX -= shift;
+            } else {
+               newLine(penX);
+               penX = 0.0f;
+            }
+            previous = codepoint;
+         }
+
+         out.glyphs.push_back(PlacedGlyph{codepoint, penX, penY});
+         penX += advance;
+      }
+      out.width = std::max(out.width, penX);
+      out.lines = lines;
+      out.height = float(lines) * lineHeight;
+   }
+};
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef TEXT_RENDERER_H
+#define TEXT_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "font_engine.h"
+#include "gl_state_cache.h"
+#include "glyph_atlas.h"
+#include "shader_compiler.h"
+#include "text_layout.h"
+
+// One glyph as the GPU sees it: a screen rectangle in pixels (top-left
+// origin), its atlas rectangle, an RGBA8 color and the SDF edge width
+// (0 for plain coverage bitmaps).
+struct TextQuad {
+   float x, y, w, h;
+   float u0, v0, u1, v1;
+   uint32_t color;
+   float smoothing;
+};
+
+// Batches every string drawn in a frame into one instanced draw. begin()
+// starts the frame, addText() and addParagraph() append one quad per visible
+// glyph, flush() uploads the atlas and the quads (orphaning the stream buffer
+// like InstanceRenderer) and issues a single glDrawArraysInstanced. All fonts
+// drawn through one renderer must share its atlas.
+class TextRenderer {
+public:
+   ~TextRenderer() {
+      if (vao) glDeleteVertexArrays(1, &vao);
+      if (quadVbo) glDeleteBuffers(1, &quadVbo);
+   }
+
+   bool init(ShaderCompiler& compiler, GLStateCache& state, GlyphAtlas& atlas) {
+      this->compiler = &compiler;
+      this->atlas = &atlas;
+      shader = compiler.submitSource("text", vertexSource, fragmentSource);
+
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &quadVbo);
+      state.bindVertexArray(vao);
+      state.bindBuffer(GL_ARRAY_BUFFER, quadVbo);
+
+      // 0 rect, 1 uv rect, 2 color, 3 smoothing; all advance per instance
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextQuad), (void*)offsetof(TextQuad, x));
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TextQuad), (void*)offsetof(TextQuad, u0));
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextQuad), (void*)offsetof(TextQuad, color));
+      glEnableVertexAttribArray(3);
+      glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(TextQuad), (void*)offsetof(TextQuad, smoothing));
+      for (GLuint i = 0; i < 4; ++i) glVertexAttribDivisor(i, 1);
+
+      state.bindVertexArray(0);
+      return true;
+   }
+
+   static uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+      return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 | uint32_t(a) << 24;
+   }
+
+   // Starts a frame drawn into a viewport of the given size in pixels
+   void begin(int viewportWidth, int viewportHeight) {
+      width = viewportWidth;
+      height = viewportHeight;
+      quads.clear();
+      glyphs.clear();
+      lookups.clear();
+      atlas->beginFrame();
+      generation = atlas->generation();
+   }
+
+   // Same, sized to the current GL viewport
+   void begin() {
+      GLint viewport[4];
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      begin(viewport[2], viewport[3]);
+   }
+
+   // Appends UTF-8 text with its first baseline at (x, y). size 0 draws the
+   // font's bitmap glyphs at its own pixel size; any other size draws its
+   // distance-field glyphs scaled to that size. '\n' starts a new line.
+   // Returns the pen position after the last glyph.
+   float addText(FontEngine& font, std::string_view text, float x, float y, uint32_t color = 0xFFFFFFFFu, float size = 0.0f) {
+      if (&font.getAtlas() != atlas) {
+         std::cerr << "TextRenderer: font uses a different glyph atlas" << std::endl;
+         return x;
+      }
+      FT_Face face = font.getFace();
+      if (!face) return x;
+
+      const bool sdf = size > 0.0f;
+      const float lineHeight = font.lineHeight(size);
+      Lookup& lookup = lookupFor(font, sdf);
+      const Style style = styleFor(size, color);
+
+      const bool kerned = font.hasKerning();
+      uint32_t previous = 0;
+      float penX = x, penY = y;
+      const char* p = text.data();
+      const char* end = p + text.size();
+      while (p < end) {
+         uint32_t codepoint = FontEngine::decodeUtf8(p, end);
+         if (codepoint == '\n') {
+            penX = x;
+            penY += lineHeight;
+            previous = 0;
+            continue;
+         }
+         // Same pair adjustments as FontEngine::measure()
+         if (kerned) {
+            if (previous) penX += font.kerning(previous, codepoint, size);
+            previous = codepoint;
+         }
+         // A glyph still being rasterized leaves a gap but keeps its advance,
+         // so the line doesn't shift when it arrives
+         emit(font, lookup, style, codepoint, penX, penY);
+         penX += font.advance(codepoint, size);
+      }
+      return penX;
+   }
+
+   // Appends a paragraph from TextLayout with its first baseline at (x, y),
+   // drawn at the size it was laid out for. Nothing is decoded or measured;
+   // the positions go straight into the quad stream.
+   void addParagraph(FontEngine& font, const TextLayout::Paragraph& paragraph, float x, float y, uint32_t color = 0xFFFFFFFFu) {
+      if (&font.getAtlas() != atlas || paragraph.font != &font) {
+         std::cerr << "TextRenderer: paragraph was laid out for a different font or atlas" << std::endl;
+         return;
+      }
+      if (!font.getFace()) return;
+
+      Lookup& lookup = lookupFor(font, paragraph.size > 0.0f);
+      const Style style = styleFor(paragraph.size, color);
+      for (const TextLayout::PlacedGlyph& placed : paragraph.glyphs) emit(font, lookup, style, placed.codepoint, x + placed.x, y + placed.y);
+   }
+
+   // Uploads and draws everything added since begin() in one call. Blending
+   // is left enabled; depth testing is left disabled.
+   void flush(GLStateCache& state) {
+      GLuint id = compiler ? compiler->program(shader) : 0;
+      if (!id || quads.empty()) return;
+
+      // A repack while the frame was built moved glyphs that earlier quads
+      // point at; none of them were evicted, so re-read their atlas rects
+      if (atlas->generation() != generation) {
+         for (size_t i = 0; i < quads.size(); ++i) {
+            const Glyph* g = glyphs[i];
+            quads[i].u0 = g->u0;
+            quads[i].v0 = g->v0;
+            quads[i].u1 = g->u1;
+            quads[i].v1 = g->v1;
+            if (g->width == 0) quads[i].w = quads[i].h = 0.0f;
+         }
+         generation = atlas->generation();
+      }
+
+      GLuint texture = atlas->upload(state);
+
+      state.bindBuffer(GL_ARRAY_BUFFER, quadVbo);
+      GLsizeiptr bytes = GLsizeiptr(quads.size() * sizeof(TextQuad));
+      if (size_t(bytes) > capacity) {
+         capacity = size_t(bytes);
+         glBufferData(GL_ARRAY_BUFFER, bytes, quads.data(), GL_STREAM_DRAW);
+      } else {
+         // Orphan so the driver does not wait for last frame's draw
+         glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(capacity), NULL, GL_STREAM_DRAW);
+         glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, quads.data());
+      }
+
+      state.useProgram(id);
+      if (id != uniformProgram) {
+         uniformProgram = id;
+         viewportLocation = glGetUniformLocation(id, "uViewport");
+         glUniform1i(glGetUniformLocation(id, "uAtlas"), 0);
+      }
+      glUniform2f(viewportLocation, float(width), float(height));
+
+      state.bindTexture(0, GL_TEXTURE_2D, texture);
+      state.setEnabled(GL_DEPTH_TEST, false);
+      state.setEnabled(GL_BLEND, true);
+      state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      state.bindVertexArray(vao);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(quads.size()));
+      drawnGlyphs = quads.size();
+   }
+
+   // Quads queued since begin(), and drawn by the last flush()
+   size_t queuedGlyphs() const { return quads.size(); }
+   size_t lastDrawnGlyphs() const { return drawnGlyphs; }
+
+   // Corners come from gl_VertexID, so no per-vertex buffer is bound
+   static constexpr const char* vertexSource =
+      "#version 440 core\n"
+      "layout (location = 0) in vec4 iRect;\n"
+      "layout (location = 1) in vec4 iUv;\n"
+      "layout (location = 2) in vec4 iColor;\n"
+      "layout (location = 3) in float iSmoothing;\n"
+      "uniform vec2 uViewport;\n"
+      "out vec2 vUv;\n"
+      "out vec4 vColor;\n"
+      "out float vSmoothing;\n"
+      "void main() {\n"
+      "   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+      "   vec2 pixel = iRect.xy + corner * iRect.zw;\n"
+      "   gl_Position = vec4(pixel.x / uViewport.x * 2.0 - 1.0, 1.0 - pixel.y / uViewport.y * 2.0, 0.0, 1.0);\n"
+      "   vUv = mix(iUv.xy, iUv.zw, corner);\n"
+      "   vColor = iColor;\n"
+      "   vSmoothing = iSmoothing;\n"
+      "}\n";
+
+   static constexpr const char* fragmentSource =
+      "#version 440 core\n"
+      "in vec2 vUv;\n"
+      "in vec4 vColor;\n"
+      "in float vSmoothing;\n"
+      "uniform sampler2D uAtlas;\n"
+      "out vec4 FragColor;\n"
+      "void main() {\n"
+      "   float d = texture(uAtlas, vUv).r;\n"
+      "   float a = vSmoothing > 0.0 ? smoothstep(0.5 - vSmoothing, 0.5 + vSmoothing, d) : d;\n"
+      "   FragColor = vec4(vColor.rgb, vColor.a * a);\n"
+      "}\n";
+
+private:
+   // Per-frame table of the ASCII glyphs a font has already resolved, per
+   // subpixel bin, so long runs of text skip the atlas hash lookups after
+   // first use. Only holds glyphs used this frame, which the atlas never
+   // evicts. Distance fields only use bin 0.
+   struct Lookup {
+      const FontEngine* font;
+      bool sdf;
+      const Glyph* ascii[FontEngine::kMaxSubpixelBins][128];
+   };
+
+   ShaderCompiler* compiler = nullptr;
+   ShaderCompiler::Handle shader = 0;
+   GlyphAtlas* atlas = nullptr;
+   GLuint vao = 0;
+   GLuint quadVbo = 0;
+   size_t capacity = 0;
+   GLuint uniformProgram = 0;
+   GLint viewportLocation = -1;
+   int width = 1, height = 1;
+   uint64_t generation = 0;
+   size_t drawnGlyphs = 0;
+   std::vector<TextQuad> quads;
+   std::vector<const Glyph*> glyphs; // parallel to quads
+   std::vector<Lookup> lookups;
+
+   Lookup& lookupFor(const FontEngine& font, bool sdf) {
+      for (Lookup& l : lookups) {
+         if (l.font == &font && l.sdf == sdf) return l;
+      }
+      lookups.push_back(Lookup{&font, sdf, {}});
+      return lookups.back();
+   }
+
+   // What every quad of one addText()/addParagraph() call shares
+   struct Style {
+      bool sdf;
+      float scale;
+      float smoothing;
+      uint32_t color;
+   };
+
+   static Style styleFor(float size, uint32_t color) {
+      Style style;
+      style.sdf = size > 0.0f;
+      style.scale = style.sdf ? size / float(FontEngine::kSdfSize) : 1.0f;
+      // Half a screen pixel, in normalized field units
+      style.smoothing = style.sdf ? 0.5f * (127.0f / 255.0f) / (float(FontEngine::kSdfSpread) * style.scale) : 0.0f;
+      style.color = color;
+      return style;
+   }
+
+   // Queues the quad for codepoint with its pen at (penX, penY); blank and
+   // not-yet-rasterized glyphs add nothing
+   void emit(FontEngine& font, Lookup& lookup, const Style& style, uint32_t codepoint, float penX, float penY) {
+      // Bitmaps land on whole pixels so they are sampled 1:1; the fraction
+      // of the pen position picks the nearest pre-shifted variant instead
+      uint8_t bin = 0;
+      if (!style.sdf) {
+         penX = font.snapToBin(penX, bin);
+         penY = std::floor(penY + 0.5f);
+      }
+
+      const Glyph* g;
+      if (codepoint < 128) {
+         g = lookup.ascii[bin][codepoint];
+         if (!g) g = lookup.ascii[bin][codepoint] = style.sdf ? font.sdfGlyph(codepoint) : font.glyph(codepoint, bin);
+      } else {
+         g = style.sdf ? font.sdfGlyph(codepoint) : font.glyph(codepoint, bin);
+      }
+      if (!g || g->width <= 0 || g->height <= 0) return;
+
+      TextQuad q;
+      q.x = penX + float(g->bearingX) * style.scale;
+      q.y = penY - float(g->bearingY) * style.scale;
+      q.w = float(g->width) * style.scale;
+      q.h = float(g->height) * style.scale;
+      q.u0 = g->u0;
+      q.v0 = g->v0;
+      q.u1 = g->u1;
+      q.v1 = g->v1;
+      q.color = style.color;
+      q.smoothing = style.smoothing;
+      quads.push_back(q);
+      glyphs.push_back(g);
+   }
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include <vector>
 #include <string>
 #include <cstring>
+#include <initializer_list>
+#include <stdexcept>
 #include <wasmtime.h>
 
 class WasmManager {
@@ -68,6 +70,31 @@ public:
       return results[0].of.i32;
    }
 
+   // Calls an export that returns nothing, e.g. a per-frame update hook
+   void call_void(const std::string& func_name, std::initializer_list<wasmtime_val_t> args) {
+      wasmtime_extern_t func_item;
+      if (!wasmtime_instance_export_get(context, &instance, func_name.c_str(), func_name.length(), &func_item)) {
+         throw std::runtime_error("Export not found: " + func_name);
+      }
+      std::vector<wasmtime_val_t> params(args);
+      wasmtime_error_t* error = wasmtime_func_call(context, &func_item.of.func, params.data(), params.size(), nullptr, 0, nullptr);
+      if (error) handle_error(error);
+   }
+
+   static wasmtime_val_t i32(int32_t value) {
+      wasmtime_val_t v;
+      v.kind = WASMTIME_I32;
+      v.of.i32 = value;
+      return v;
+   }
+
+   static wasmtime_val_t f32(float value) {
+      wasmtime_val_t v;
+      v.kind = WASMTIME_F32;
+      v.of.f32 = value;
+      return v;
+   }
+
    // Helper to get a raw pointer to a specific offset in WASM memory
    void* get_memory_ptr(uint32_t offset) {
       wasmtime_extern_t mem_item;
@@ -5,6 +5,17 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 
@@ -12,14 +23,596 @@ const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
 #include "font_engine.h"
-//#include "gl_widget.h"
+#include "glyph_cache.h"
+#include "glyph_rasterizer.h"
+#include "log_viewer.h"
+#include "mesh_pool.h"
+#include "gl_widget.h"
 #include "wasm_manager.h"
 #include "database_manager.h"
 #include "native_window_manager.h"
+#include "occlusion_culler.h"
+#include "instance_renderer.h"
+#include "render_queue.h"
+#include "render_thread.h"
+#include "scene_graph.h"
+#include "shader_hot_reload.h"
+#include "shared_gpu_resources.h"
+#include "text_layout.h"
+#include "text_renderer.h"
+
+// Printable ASCII as bitmaps at every UI size versus one distance-field set
+static void printGlyphReport(const char* fontPath) {
+   auto measure = [fontPath](int size, bool distanceField, size_t& bytes, double& ms) {
+      GlyphAtlas atlas(2048, 2048);
+      FontEngine engine(&atlas);
+      if (!engine.init(fontPath, size)) return;
+      auto start = std::chrono::steady_clock::now();
+      for (uint32_t c = 32; c < 127; ++c) {
+         const Glyph* g = distanceField ? engine.sdfGlyph(c) : engine.glyph(c);
+         if (g) bytes += size_t(g->width) * g->height;
+      }
+      ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+   };
+
+   size_t bitmapBytes = 0;
+   double bitmapMs = 0.0;
+   for (int size : {12, 16, 24, 32, 48, 64, 96, 128}) measure(size, false, bitmapBytes, bitmapMs);
+   size_t sdfBytes = 0;
+   double sdfMs = 0.0;
+   measure(FontEngine::kSdfSize, true, sdfBytes, sdfMs);
+
+   std::cout << "Bitmap glyphs, 8 sizes: " << bitmapBytes / 1024 << " KiB, " << bitmapMs << " ms" << std::endl;
+   std::cout << "SDF glyphs, all sizes:  " << sdfBytes / 1024 << " KiB, " << sdfMs << " ms ("
+             << JobSystem::shared().workerCount() + 1 << " threads)" << std::endl;
+
+   // Pre-warming Latin (bitmap and SDF) on the calling thread vs the rasterizer
+   for (bool threaded : {false, true}) {
+      GlyphAtlas atlas(2048, 2048);
+      FontEngine engine(&atlas);
+      if (!engine.init(fontPath, 48)) return;
+      auto start = std::chrono::steady_clock::now();
+      unsigned workers = 0;
+      if (threaded) {
+         GlyphRasterizer rasterizer(engine);
+         workers = rasterizer.workerCount();
+         rasterizer.requestRange(0x20, 0x24F);
+         rasterizer.requestRange(0x20, 0x24F, true);
+         while (rasterizer.outstanding()) {
+            if (!rasterizer.publish(atlas)) std::this_thread::yield();
+         }
+         std::cout << "Font file mapped once: " << MappedFont::residentBytes() / 1024 << " KiB shared by "
+                   << workers + 1 << " faces" << std::endl;
+      } else {
+         for (uint32_t c = 0x20; c <= 0x24F; ++c) {
+            engine.glyph(c);
+            engine.sdfGlyph(c);
+         }
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "Pre-warm " << atlas.size() << " glyphs, " << (threaded ? std::to_string(workers) + " rasterizer threads: " : "calling thread: ")
+                << ms << " ms" << std::endl;
+   }
+
+   // ASCII (bitmap and SDF) from FreeType, then from the on-disk cache
+   GlyphCache cache((std::filesystem::temp_directory_path() / "enigma_glyph_report").string());
+   for (bool warm : {false, true}) {
+      GlyphAtlas atlas;
+      FontEngine engine(&atlas);
+      if (!engine.init(fontPath, 48)) return;
+      auto start = std::chrono::steady_clock::now();
+      size_t loaded = warm ? cache.load(engine) : 0;
+      if (!warm) {
+         for (uint32_t c = 0x20; c <= 0x7E; ++c) {
+            engine.glyph(c);
+            engine.sdfGlyph(c);
+         }
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      std::cout << (warm ? "Warm glyph cache: " : "Cold glyph cache: ") << atlas.size() << " glyphs in " << ms << " ms"
+                << (warm ? " (" + std::to_string(loaded) + " loaded)" : std::string()) << std::endl;
+      if (!warm) cache.save(engine);
+   }
+
+   // Throughput of FontEngine::measure() over 1 MiB of text
+   FontEngine engine;
+   if (!engine.init(fontPath, 48)) return;
+   const std::pair<const char*, const char*> samples[] = {
+      {"ASCII", "The quick brown fox jumps over the lazy dog, said the layout engine. "},
+      {"Mixed UTF-8", "Gr\xC3\xB6\xC3\x9F" "en\xC3\xA4nderung f\xC3\xBCr Fenster \xE2\x80\x94 \xD1\x82\xD0\xB5\xD0\xBA\xD1\x81\xD1\x82 layout "},
+   };
+   for (const auto& sample : samples) {
+      std::string text;
+      while (text.size() < (1u << 20)) text += sample.second;
+      const int passes = 20;
+      float width = 0.0f;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < passes; ++i) width += engine.measure(text);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "measure() " << sample.first << ": " << double(text.size()) * passes / seconds / 1e6 << " MB/s (width "
+                << width / float(passes) << " px)" << std::endl;
+   }
+
+   // A 10K-line log view wrapped to the window, one line rewritten per
+   // frame: laying every paragraph out again vs the paragraph cache
+   FontEngine logFont;
+   if (!logFont.init(fontPath, 16)) return;
+   for (bool cached : {false, true}) {
+      std::vector<std::string> log(10000);
+      for (size_t i = 0; i < log.size(); ++i) {
+         log[i] = "[" + std::to_string(i) + "] frame " + std::to_string(i * 16) + " ms: uploaded " + std::to_string(i % 97) +
+                  " instances, atlas generation " + std::to_string(i % 13) + ", nothing else of note happened";
+      }
+      TextLayout layout;
+      const int frames = 120;
+      size_t visibleGlyphs = 0;
+      float contentHeight = 0.0f;
+      auto start = std::chrono::steady_clock::now();
+      // Frame 0 fills the cache and isn't timed
+      for (int frame = 0; frame <= frames; ++frame) {
+         if (frame == 1) start = std::chrono::steady_clock::now();
+         log[size_t(frame) * 83 % log.size()] += " (updated)";
+         if (!cached) layout.clear();
+         layout.beginFrame();
+         // Heights of every line place the scrolled-to-bottom window
+         float y = 0.0f;
+         visibleGlyphs = 0;
+         for (const std::string& line : log) {
+            const TextLayout::Paragraph& p = layout.layout(logFont, line, float(SCR_WIDTH));
+            if (y + p.height > contentHeight - float(SCR_HEIGHT)) visibleGlyphs += p.glyphs.size();
+            y += p.height;
+         }
+         contentHeight = y;
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+      std::cout << "Log view, " << log.size() << " lines, " << (cached ? "paragraph cache: " : "full relayout: ") << ms << " ms/frame ("
+                << layout.getStats().misses << " laid out, " << visibleGlyphs << " visible glyphs)" << std::endl;
+   }
+
+   // Small bitmap text: how far glyphs land from their unrounded positions
+   // at each subpixel bin count, and what the extra variants cost
+   const std::string uiText = "Window size 800 x 600, 60 fps, 2 draw calls; kerning and spacing matter most at small sizes.";
+   for (int bins : {1, 2, 4, 8}) {
+      GlyphAtlas atlas;
+      FontEngine ui(&atlas);
+      if (!ui.init(fontPath, 12) || !ui.setSubpixelBins(bins)) return;
+      TextLayout layout;
+      const TextLayout::Paragraph& exact = layout.layout(ui, uiText, 0.0f, 12.0f);
+      const TextLayout::Paragraph& placed = layout.layout(ui, uiText);
+
+      double worst = 0.0, total = 0.0;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < placed.glyphs.size(); ++i) {
+         uint8_t bin;
+         float origin = ui.snapToBin(placed.glyphs[i].x, bin);
+         double error = std::abs(double(origin) + double(bin) / bins - double(exact.glyphs[i].x));
+         worst = std::max(worst, error);
+         total += error;
+         ui.glyph(placed.glyphs[i].codepoint, bin);
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      size_t bytes = 0;
+      atlas.forEach([&bytes](const GlyphKey&, const Glyph& g) { bytes += size_t(g.width) * g.height; });
+      std::cout << "12 px text, " << bins << " subpixel bin" << (bins > 1 ? "s: " : ":  ") << "mean error " << total / placed.glyphs.size()
+                << " px, max " << worst << " px; " << atlas.size() << " glyphs, " << bytes / 1024.0 << " KiB, " << ms << " ms" << std::endl;
+   }
+}
+
+// 100K one-pixel draws recorded from 4 threads across 16 programs and 64
+// vertex arrays, then issued by RenderQueue in sort-key order versus in
+// the order they were recorded. Needs a current context.
+static void printQueueBench() {
+   const int threads = 4;
+   const int drawsPerThread = 25000;
+   const int programs = 16;
+   const int vertexArrays = 64;
+   const int frames = 5;
+
+   const char* vertexSource =
+      "#version 440 core\n"
+      "void main() {\n"
+      "   vec2 p[3] = vec2[](vec2(-1.0, -1.0), vec2(-0.999, -1.0), vec2(-1.0, -0.999));\n"
+      "   gl_Position = vec4(p[gl_VertexID], 0.0, 1.0);\n"
+      "}\n";
+   const char* fragmentSource =
+      "#version 440 core\n"
+      "out vec4 color;\n"
+      "void main() { color = vec4(1.0); }\n";
+
+   ShaderCompiler shaders;
+   std::vector<GLuint> programIds;
+   for (int i = 0; i < programs; ++i) programIds.push_back(shaders.program(shaders.submitSource("bench", vertexSource, fragmentSource)));
+   std::vector<GLuint> vaos(vertexArrays);
+   glGenVertexArrays(GLsizei(vaos.size()), vaos.data());
+
+   // What each thread records every frame: random programs, vertex arrays
+   // and depths, with one packet in 64 left with no instances (say, all of
+   // them culled)
+   std::vector<std::vector<DrawPacket>> work(threads);
+   std::mt19937 random(1);
+   for (std::vector<DrawPacket>& packets : work) {
+      for (int i = 0; i < drawsPerThread; ++i) {
+         uint32_t program = random() % programs, vao = random() % vertexArrays;
+         uint64_t key = SortKey::make(0, program, vao, SortKey::depthBits(float(random() % 1000)));
+         GLsizei instances = random() % 64 ? 1 : 0;
+         packets.push_back({key, programIds[program], vaos[vao], 0, GL_TRIANGLES, 0, 0, 3, instances, 0});
+      }
+   }
+
+   GLStateCache state;
+   RenderQueue queue;
+   double recordMs = 0.0, sortMs = 0.0, executeMs = 0.0, unsortedMs = 0.0;
+   uint32_t sortedStates = 0, unsortedStates = 0;
+   size_t drawCalls = 0;
+   for (int frame = 0; frame < frames; ++frame) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> workers;
+      for (int t = 0; t < threads; ++t) {
+         workers.emplace_back([&queue, &work, t] {
+            CommandBuffer& commands = queue.acquireBuffer();
+            for (const DrawPacket& packet : work[size_t(t)]) commands.draw(packet);
+         });
+      }
+      for (std::thread& worker : workers) worker.join();
+      recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      // Execute times include waiting for the GPU to finish the draws
+      state.invalidate();
+      state.beginFrame();
+      start = std::chrono::steady_clock::now();
+      queue.submit(state);
+      glFinish();
+      double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      sortMs += queue.lastStats().sortMs;
+      executeMs += submitMs - queue.lastStats().sortMs;
+      sortedStates = state.thisFrame().issued;
+      drawCalls = queue.lastStats().drawCalls;
+
+      state.invalidate();
+      state.beginFrame();
+      start = std::chrono::steady_clock::now();
+      // The same packets in recording order, through the same state cache
+      for (const std::vector<DrawPacket>& packets : work) {
+         for (const DrawPacket& p : packets) {
+            if (!p.instances) continue;
+            state.useProgram(p.program);
+            state.bindVertexArray(p.vertexArray);
+            glDrawArrays(p.mode, p.first, p.count);
+         }
+      }
+      glFinish();
+      unsortedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      unsortedStates = state.thisFrame().issued;
+   }
+
+   std::cout << "Render queue, " << threads * drawsPerThread << " draws from " << threads << " threads, mean of " << frames << " frames:" << std::endl;
+   std::cout << "  record " << recordMs / frames << " ms, merge+sort " << sortMs / frames << " ms, execute " << executeMs / frames
+             << " ms, " << drawCalls << " draw calls, " << sortedStates << " state changes" << std::endl;
+   std::cout << "  unsorted execute " << unsortedMs / frames << " ms, " << unsortedStates << " state changes" << std::endl;
+
+   glDeleteVertexArrays(GLsizei(vaos.size()), vaos.data());
+   for (GLuint program : programIds) glDeleteProgram(program);
+}
+
+// meshes small polygons (3 to 10 sides) packed into one MeshPool, drawn
+// with a single glMultiDrawElementsIndirect versus one draw call per mesh
+// from the same buffers. Needs a current context.
+static void printMeshPoolBench(unsigned long meshes) {
+   const int frames = 5;
+
+   ShaderCompiler shaders;
+   GLuint program = shaders.program(shaders.submitSource("mesh pool", InstanceRenderer::vertexSource, InstanceRenderer::fragmentSource));
+   GLStateCache state;
+
+   // Fans around a centre vertex, each mesh with its own vertex and index
+   // ranges; indices are local to the mesh
+   std::mt19937 random(1);
+   std::vector<std::vector<float>> vertices(meshes);
+   std::vector<std::vector<uint32_t>> indices(meshes);
+   uint32_t totalVertices = 0, totalIndices = 0;
+   for (unsigned long m = 0; m < meshes; ++m) {
+      uint32_t sides = 3 + random() % 8;
+      std::vector<float>& v = vertices[m];
+      v.insert(v.end(), {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f});
+      for (uint32_t k = 0; k < sides; ++k) {
+         float angle = 6.2831853f * float(k) / float(sides);
+         v.insert(v.end(), {std::cos(angle), std::sin(angle), 0.0f, float(k & 1), 0.5f, float(~k & 1)});
+         indices[m].insert(indices[m].end(), {0, k + 1, (k + 1) % sides + 1});
+      }
+      totalVertices += sides + 1;
+      totalIndices += 3 * sides;
+   }
+
+   MeshPool pool;
+   auto start = std::chrono::steady_clock::now();
+   pool.init(state, totalVertices, totalIndices);
+   std::vector<MeshHandle> handles(meshes);
+   for (unsigned long m = 0; m < meshes; ++m) {
+      if (!pool.add(state, vertices[m].data(), uint32_t(vertices[m].size() / 6), indices[m].data(), uint32_t(indices[m].size()), handles[m])) return;
+   }
+   double packMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+   // Scattered over the screen, each a hundredth of it across
+   std::vector<InstanceData> placement(meshes);
+   std::uniform_real_distribution<float> position(-1.0f, 1.0f), shade(0.2f, 1.0f);
+   for (InstanceData& d : placement) {
+      std::fill(std::begin(d.transform), std::end(d.transform), 0.0f);
+      d.transform[0] = d.transform[5] = 0.01f;
+      d.transform[10] = d.transform[15] = 1.0f;
+      d.transform[12] = position(random);
+      d.transform[13] = position(random);
+      d.color[0] = shade(random);
+      d.color[1] = shade(random);
+      d.color[2] = shade(random);
+      d.color[3] = 1.0f;
+   }
+
+   // Times include waiting for the GPU to finish the draws
+   double multiMs = 0.0, separateMs = 0.0;
+   size_t collapsed = 0;
+   uint32_t multiCalls = 0, separateCalls = 0;
+   for (int frame = 0; frame < frames; ++frame) {
+      state.invalidate();
+      start = std::chrono::steady_clock::now();
+      for (unsigned long m = 0; m < meshes; ++m) pool.queue(handles[m], placement[m]);
+      collapsed = pool.drawQueued(state, program);
+      glFinish();
+      multiMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      multiCalls = collapsed ? 1 : 0;
+
+      // The per-draw records drawQueued() uploaded stay in place, so each
+      // mesh can reach its own through baseInstance
+      state.invalidate();
+      start = std::chrono::steady_clock::now();
+      state.useProgram(program);
+      state.bindVertexArray(pool.vertexArray());
+      separateCalls = 0;
+      for (unsigned long m = 0; m < meshes; ++m) {
+         const MeshHandle& h = handles[m];
+         glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, GLsizei(h.indexCount), GL_UNSIGNED_INT,
+                                                      (void*)(uintptr_t(h.firstIndex) * sizeof(uint32_t)), 1,
+                                                      GLint(h.firstVertex), GLuint(m));
+         ++separateCalls;
+      }
+      glFinish();
+      separateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+   }
+
+   std::cout << "Mesh pool, " << meshes << " meshes (" << totalVertices << " vertices, " << totalIndices << " indices) packed in "
+             << packMs << " ms; mean of " << frames << " frames:" << std::endl;
+   std::cout << "  multi-draw indirect: " << multiCalls << " draw call issued, " << collapsed << " draws collapsed, " << multiMs / frames
+             << " ms" << std::endl;
+   std::cout << "  one call per mesh: " << separateCalls << " draw calls issued, " << separateMs / frames << " ms" << std::endl;
+
+   glDeleteProgram(program);
+}
+
+// 1M objects under a SceneGraph, culled against a camera at the centre of
+// the scene while every frame a tenth of them move a little, a hundred jump
+// further and a thousand are destroyed and recreated. What the frustum keeps
+// then goes through the occlusion culler. Ends by checking that every live
+// object, and nothing else, comes back from a frustum around the whole
+// scene. CPU only.
+static void printCullBench() {
+   const uint32_t objects = 1000000;
+   const uint32_t movesPerFrame = objects / 10;
+   const uint32_t jumpsPerFrame = 100;
+   const uint32_t churnPerFrame = 1000;
+   const int frames = 60;
+   const float extent = 500.0f;
+
+   std::mt19937 random(1);
+   std::uniform_real_distribution<float> place(-extent, extent), jitter(-1.0f, 1.0f);
+   const Aabb unitBox = {{-1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, 1.0f}};
+
+   // userData is the index into these; a node's transform is a translation
+   std::vector<SceneGraph::NodeId> nodes(objects);
+   std::vector<float> transforms(size_t(objects) * 16);
+   SceneGraph scene;
+   auto placeObject = [&](uint32_t i) {
+      float* m = &transforms[size_t(i) * 16];
+      std::fill(m, m + 16, 0.0f);
+      m[0] = m[5] = m[10] = m[15] = 1.0f;
+      m[12] = place(random);
+      m[13] = place(random);
+      m[14] = place(random);
+   };
+
+   auto start = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < objects; ++i) {
+      placeObject(i);
+      nodes[i] = scene.create(unitBox, i);
+      scene.setLocalTransform(nodes[i], &transforms[size_t(i) * 16]);
+   }
+   scene.update();
+   double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+   // Column-major perspective, 60 degrees, 16:9, looking down -z from the origin
+   const float nearZ = 0.1f, farZ = 400.0f, focal = 1.0f / std::tan(0.5236f);
+   float projection[16] = {};
+   projection[0] = focal * 9.0f / 16.0f;
+   projection[5] = focal;
+   projection[10] = (farZ + nearZ) / (nearZ - farZ);
+   projection[11] = -1.0f;
+   projection[14] = 2.0f * farZ * nearZ / (nearZ - farZ);
+   const Frustum camera = Frustum::fromMatrix(projection);
+
+   // Three walls ahead of the camera hide part of what the frustum keeps;
+   // the occlusion pass drops what is behind them
+   const float walls[] = {-20.0f, -10.0f, -30.0f, 5.0f, -10.0f, -30.0f, 5.0f, 10.0f, -30.0f, -20.0f, 10.0f, -30.0f,
+                          0.0f, -40.0f, -60.0f, 60.0f, -40.0f, -60.0f, 60.0f, 10.0f, -60.0f, 0.0f, 10.0f, -60.0f,
+                          -80.0f, 0.0f, -90.0f, -20.0f, 0.0f, -90.0f, -20.0f, 60.0f, -90.0f, -80.0f, 60.0f, -90.0f};
+   const uint32_t wallIndices[] = {0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7, 8, 9, 10, 8, 10, 11};
+   OcclusionCuller occlusion(JobSystem::shared());
+   auto worldBox = [&transforms](uint32_t i) {
+      const float* m = &transforms[size_t(i) * 16];
+      return Aabb{{m[12] - 1.0f, m[13] - 1.0f, m[14] - 1.0f}, {m[12] + 1.0f, m[13] + 1.0f, m[14] + 1.0f}};
+   };
+
+   std::vector<uint32_t> visible, unoccluded;
+   visible.reserve(objects / 8);
+   unoccluded.reserve(objects / 8);
+   FrameStats updateTimes, cullTimes, rasterTimes, occlusionTestTimes;
+   CullStats total;
+   size_t occluded = 0;
+   for (int frame = 0; frame < frames; ++frame) {
+      start = std::chrono::steady_clock::now();
+      for (uint32_t k = 0; k < movesPerFrame; ++k) {
+         uint32_t i = random() % objects;
+         float* m = &transforms[size_t(i) * 16];
+         for (int a = 12; a < 15; ++a) m[a] += jitter(random);
+         scene.setLocalTransform(nodes[i], m);
+      }
+      // Jumps leave loose subtrees behind that update() rebuilds on their own
+      for (uint32_t k = 0; k < jumpsPerFrame; ++k) {
+         uint32_t i = random() % objects;
+         float* m = &transforms[size_t(i) * 16];
+         for (int a = 12; a < 15; ++a) m[a] += 20.0f * jitter(random);
+         scene.setLocalTransform(nodes[i], m);
+      }
+      for (uint32_t k = 0; k < churnPerFrame; ++k) {
+         uint32_t i = random() % objects;
+         scene.destroy(nodes[i]);
+         placeObject(i);
+         nodes[i] = scene.create(unitBox, i);
+         scene.setLocalTransform(nodes[i], &transforms[size_t(i) * 16]);
+      }
+      scene.update();
+      updateTimes.push(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+      CullStats stats;
+      visible.clear();
+      scene.cull(camera, visible, &stats);
+      cullTimes.push(stats.ms);
+      total.nodesVisited += stats.nodesVisited;
+      total.boxesTested += stats.boxesTested;
+      total.acceptedWhole += stats.acceptedWhole;
+      total.visible += stats.visible;
+
+      occlusion.beginFrame(projection);
+      occlusion.addOccluder(walls, 12, wallIndices, 18);
+      occlusion.render();
+      unoccluded.clear();
+      occlusion.filter(visible, worldBox, unoccluded);
+      rasterTimes.push(occlusion.stats().rasterMs + occlusion.stats().pyramidMs);
+      occlusionTestTimes.push(occlusion.stats().testMs);
+      occluded += occlusion.stats().occluded;
+   }
+
+   const float everything[16] = {1.0f / (2.0f * extent), 0, 0, 0, 0, 1.0f / (2.0f * extent), 0, 0,
+                                 0, 0, 1.0f / (2.0f * extent), 0, 0, 0, 0, 1.0f};
+   visible.clear();
+   scene.cull(Frustum::fromMatrix(everything), visible);
+   std::vector<uint8_t> seen(objects, 0);
+   size_t wrong = 0;
+   for (uint32_t i : visible) {
+      if (i >= objects || seen[i]++) ++wrong;
+   }
+   wrong += size_t(std::count(seen.begin(), seen.end(), uint8_t(0)));
+
+   std::cout << "Scene cull, " << objects << " objects, " << scene.index().nodeCount() << " BVH nodes, built in " << buildMs
+             << " ms" << std::endl;
+   std::cout << "  per frame (" << movesPerFrame << " moved, " << jumpsPerFrame << " jumped, " << churnPerFrame << " recreated): update p50 "
+             << updateTimes.p50() << " ms, cull p50 " << cullTimes.p50() << " ms, p99 "
+             << cullTimes.p99() << " ms" << std::endl;
+   std::cout << "  mean per frame: " << total.nodesVisited / frames << " nodes visited, " << total.boxesTested / frames
+             << " boxes tested, " << total.acceptedWhole / frames << " subtrees accepted whole, " << total.visible / frames
+             << " visible" << std::endl;
+   std::cout << "  occlusion (" << occlusion.getWidth() << "x" << occlusion.getHeight() << ", " << JobSystem::shared().workerCount() + 1
+             << " threads): rasterize p50 " << rasterTimes.p50() << " ms, test p50 " << occlusionTestTimes.p50() << " ms, p99 "
+             << occlusionTestTimes.p99() << " ms, " << occluded / frames << " of the visible occluded" << std::endl;
+   std::cout << "  whole-scene check: " << (wrong ? std::to_string(wrong) + " objects missing or duplicated" : "ok") << std::endl;
+}
+
+// Reads the non-negative decimal count after flag, or prints how the flag
+// is used and returns false
+static bool parseCount(const char* flag, const char* value, unsigned long& out) {
+   char* end = nullptr;
+   errno = 0;
+   unsigned long parsed = value ? std::strtoul(value, &end, 10) : 0;
+   if (!value || end == value || *end != '\0' || errno == ERANGE || value[0] == '-') {
+      std::cerr << "Usage: " << flag << " <count>, got " << (value ? "'" + std::string(value) + "'" : std::string("nothing"))
+                << std::endl;
+      return false;
+   }
+   out = parsed;
+   return true;
+}
 
 int main(int argc, char *argv[]) {
+   const auto launchTime = std::chrono::steady_clock::now();
    QApplication app(argc, argv);
 
+   // --headless <frames>: render offscreen with no display and log timings
+   // --capture <n>: save every nth frame as capture_<frame>.png
+   // --render-thread: submit GL from a dedicated thread fed by frame packets
+   // --text <glyphs>: also draw this many distance-field glyphs each frame
+   // --instances <n>: instanced triangles the guest lays out (default and
+   //   at most 100000, the size of its buffer)
+   // --animate: spin the instances; otherwise they stay put and the
+   //   on-demand loop can idle between input events
+   // --glyph-report: compare glyph rasterization, caching and text layout costs
+   // --bench-queue: time 100K render queue draws, sorted vs recording order
+   // --bench-meshes <n>: draw n pooled meshes with one multi-draw vs one
+   //   call each
+   // --bench-cull: time frustum and occlusion culling of 1M moving objects
+   // --logs: show the logs table as a scrollable overlay (mouse wheel)
+   // --qt-widget: once the window closes, draw the triangle and title again
+   //   in a Qt widget from the GL objects the window created
+   unsigned long headlessFrames = 0;
+   unsigned long captureEvery = 0;
+   unsigned long stressGlyphs = 0;
+   unsigned long instanceCount = 100000;
+   bool renderThread = false;
+   bool showLogs = false;
+   bool qtWidget = false;
+   bool benchQueue = false;
+   unsigned long benchMeshes = 0;
+   bool animate = false;
+   for (int i = 1; i < argc; ++i) {
+      if (std::string(argv[i]) == "--render-thread") renderThread = true;
+      if (std::string(argv[i]) == "--logs") showLogs = true;
+      if (std::string(argv[i]) == "--qt-widget") qtWidget = true;
+      if (std::string(argv[i]) == "--bench-queue") benchQueue = true;
+      if (std::string(argv[i]) == "--animate") animate = true;
+      if (std::string(argv[i]) == "--glyph-report") {
+         printGlyphReport("FiraMono-Regular.ttf");
+         return 0;
+      }
+      if (std::string(argv[i]) == "--bench-cull") {
+         printCullBench();
+         return 0;
+      }
+
+      unsigned long* count = nullptr;
+      if (std::string(argv[i]) == "--headless") count = &headlessFrames;
+      if (std::string(argv[i]) == "--capture") count = &captureEvery;
+      if (std::string(argv[i]) == "--text") count = &stressGlyphs;
+      if (std::string(argv[i]) == "--instances") count = &instanceCount;
+      if (std::string(argv[i]) == "--bench-meshes") count = &benchMeshes;
+      if (!count) continue;
+      if (!parseCount(argv[i], i + 1 < argc ? argv[i + 1] : nullptr, *count)) return -1;
+      ++i;
+   }
+
+   // Declared first so it is destroyed last: everything below that owns GL
+   // objects (the glyph atlas texture included) must go while the context
+   // is still alive
+   NativeWindowManager nativeWin(SCR_WIDTH, SCR_HEIGHT, "Enigma Engine",
+                                 headlessFrames ? NativeWindowManager::Backend::Headless
+                                                : NativeWindowManager::Backend::Window);
+   if (!nativeWin.init()) {
+      return -1;
+   }
+   if (benchQueue) {
+      printQueueBench();
+      return 0;
+   }
+   if (benchMeshes) {
+      printMeshPoolBench(benchMeshes);
+      return 0;
+   }
+
    FontEngine fonts;
    if (!fonts.init("FiraMono-Regular.ttf", 48)) {
       return -1;
@@ -29,9 +622,23 @@ int main(int argc, char *argv[]) {
       return -1;
    }
 
-   NativeWindowManager nativeWin(SCR_WIDTH, SCR_HEIGHT, "Enigma Engine");
-   if (!nativeWin.init()) {
-      return -1;
+   // From here on glyphs are rasterized off the render thread and show up
+   // once published
+   GlyphRasterizer glyphRasterizer(fonts);
+   // A warm start restores last run's glyphs and skips FreeType entirely
+   GlyphCache glyphCache;
+   size_t cachedGlyphs = glyphCache.load(fonts);
+   if (!cachedGlyphs) {
+      glyphRasterizer.requestRange(0x20, 0x7E);
+      glyphRasterizer.requestRange(0x20, 0x7E, true);
+   }
+
+   std::ofstream frameLog;
+   if (headlessFrames) {
+      nativeWin.setHeadlessFrameLimit(headlessFrames);
+      frameLog.open("frame_times.csv");
+      frameLog << "frame,cpu_ms,total_ms,gpu_ms,gpu_passes\n";
+      nativeWin.setFrameLog(&frameLog);
    }
 
    try {
@@ -42,36 +649,218 @@ int main(int argc, char *argv[]) {
       std::cout << "Number of 'e's found by Zig: " << count << std::endl;
 
       DatabaseManager dbManager("app_data.db");
-      if (dbManager.open()) {
+      bool dbOpen = dbManager.open();
+      if (dbOpen) {
          dbManager.logMessage(message);
       }
 
+      // Pages through the table on this thread; only the visible rows go
+      // to the renderer
+      const float logSize = 14.0f;
+      const float logTop = 90.0f;
+      std::unique_ptr<LogViewer> logViewer;
+      if (showLogs && dbOpen) logViewer.reset(new LogViewer(dbManager, int((float(SCR_HEIGHT) - logTop) / fonts.lineHeight(logSize))));
+      const double rowsPerWheelStep = 3.0;
+
       uint32_t v_offset = wasm.get_wasm_ptr("get_vertex_ptr");
       float* triangle_data_ptr = static_cast<float*>(wasm.get_memory_ptr(v_offset));
       size_t data_size = 3 * 6 * sizeof(float);
-/*
-      QWidget mainContainer;
-      QVBoxLayout *layout = new QVBoxLayout(&mainContainer);
 
-      QPushButton *btn = new QPushButton("Refresh Wasm Data");
-      MyGLWidget *glWidget = new MyGLWidget();
+      ShaderCompiler shaders(nativeWin.createSharedContext());
+      GLStateCache& glState = nativeWin.getStateCache();
+
+      // The WASM triangle is uploaded once here; the Qt widget reuses it
+      // when its context can share with this one
+      SharedGpuResources sharedGpu;
+      if (!nativeWin.isHeadless()) sharedGpu.shareWithQt(nativeWin.getWindow());
+      GLuint triangleVbo = sharedGpu.buffer(glState, "wasm_triangle", GL_ARRAY_BUFFER, triangle_data_ptr, data_size, GL_DYNAMIC_DRAW);
+
+      InstanceRenderer instances;
+      instances.init(shaders, glState, triangleVbo, 3);
+      // The instance shader is read from disk when it is there, and edits to
+      // it are recompiled in the background and swapped in between frames
+      ShaderHotReloader shaderReloader(shaders);
+      if (instances.loadShader("shaders/instanced.vert", "shaders/instanced.frag")) {
+         shaderReloader.watch(instances.shaderHandle());
+         shaderReloader.start();
+      }
+
+      TextRenderer text;
+      text.init(shaders, glState, fonts.getAtlas());
+      std::string stressText;
+      while (stressText.size() < stressGlyphs) stressText += "The quick brown fox jumps over the lazy dog 0123456789\n";
+      stressText.resize(stressGlyphs);
+      const std::string title = "Enigma Engine";
+      const size_t titleGlyphs = size_t(std::count_if(title.begin(), title.end(), [](char c) { return c != ' '; }));
+      double firstTextMs = -1.0;
+      // Only the render thread touches fonts once the loop starts
+      auto drawText = [&](const LogViewer::Window* logs) {
+         glyphRasterizer.publish(fonts.getAtlas());
+         text.begin();
+         text.addText(fonts, title, 16.0f, 56.0f);
+         bool titleComplete = text.queuedGlyphs() == titleGlyphs;
+         if (!stressText.empty()) text.addText(fonts, stressText, 0.0f, 80.0f, TextRenderer::rgba(200, 220, 255), 6.0f);
+         if (logs) logViewer->draw(text, fonts, *logs, 16.0f, logTop, logSize, TextRenderer::rgba(180, 255, 180));
+         text.flush(glState);
+         if (firstTextMs < 0.0 && titleComplete) {
+            firstTextMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count();
+         }
+      };
+
+      FrameCapture capture;
+      if (captureEvery) nativeWin.setFrameCapture(&capture, captureEvery, "capture_");
+
+      double simTime = 0.0;
 
-      glWidget->setVertexData(triangle_data_ptr, data_size);
+      if (renderThread) {
+         // The main thread keeps events and scripting; the render thread
+         // draws the previous frame's packet while the next one is built
+         struct FramePacket {
+            std::vector<InstanceData> instances;
+            LogViewer::Window logs;
+         };
+
+         RenderThread<FramePacket> renderer(nativeWin, [&](const FramePacket& frame) {
+            shaderReloader.update(renderer.renderStats().last());
+            GpuProfiler& gpu = nativeWin.getGpuProfiler();
+            glState.beginFrame();
+            {
+               GpuScope scope(gpu, "clear");
+               glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+            {
+               GpuScope scope(gpu, "instances");
+               instances.upload(glState, frame.instances.data(), frame.instances.size());
+               instances.draw(glState);
+            }
+            {
+               GpuScope scope(gpu, "text");
+               drawText(logViewer ? &frame.logs : nullptr);
+            }
+         });
+
+         const double step = nativeWin.getLoopConfig().fixedTimestep;
+         renderer.start();
+         while (!nativeWin.shouldClose()) {
+            nativeWin.pollEvents();
+            simTime += step;
+            // One step per packet, so the render thread draws whole steps
+            const float drawnTime = animate ? static_cast<float>(simTime) : 0.0f;
+            wasm.call_void("update_instances", {WasmManager::i32(int32_t(instanceCount)), WasmManager::f32(drawnTime)});
+
+            uint32_t count = wasm.get_wasm_ptr("get_instance_count");
+            auto* data = static_cast<const InstanceData*>(wasm.get_memory_ptr(wasm.get_wasm_ptr("get_instance_ptr")));
+            renderer.packet().instances.assign(data, data + count);
+            if (logViewer) {
+               logViewer->scroll(-nativeWin.takeScroll() * rowsPerWheelStep);
+               logViewer->update(step);
+               renderer.packet().logs = logViewer->window();
+            }
+            renderer.submit();
+         }
+         renderer.stop();
+
+         const FrameStats& renderFrames = renderer.renderStats();
+         const FrameStats& waits = renderer.submitWaitTimes();
+         std::cout << "Render thread p50: " << renderFrames.p50() << " ms, p99: " << renderFrames.p99() << " ms" << std::endl;
+         std::cout << "Simulation waited p50: " << waits.p50() << " ms, p99: " << waits.p99() << " ms" << std::endl;
+      } else {
+         nativeWin.run(
+            [&](double dt) {
+               simTime += dt;
+               if (animate) nativeWin.requestRedraw();
+               if (logViewer) {
+                  logViewer->scroll(-nativeWin.takeScroll() * rowsPerWheelStep);
+                  if (logViewer->update(dt)) nativeWin.requestRedraw();
+               }
+            },
+            [&](double alpha) {
+               // The guest lays the instances out for the time between the
+               // last two steps that alpha points at, so they move smoothly
+               // whatever the frame rate; it only reports a change, and the
+               // instances are only uploaded, when that time moved
+               const double step = nativeWin.getLoopConfig().fixedTimestep;
+               const float drawnTime = animate ? static_cast<float>(simTime - step + alpha * step) : 0.0f;
+               wasm.call_void("update_instances", {WasmManager::i32(int32_t(instanceCount)), WasmManager::f32(drawnTime)});
+               bool changed = wasm.get_wasm_ptr("take_dirty") != 0;
+
+               shaderReloader.update(nativeWin.getFrameStats().last());
+               GpuProfiler& gpu = nativeWin.getGpuProfiler();
+               glState.beginFrame();
+               {
+                  GpuScope scope(gpu, "clear");
+                  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+               }
+               {
+                  GpuScope scope(gpu, "instances");
+                  if (changed) {
+                     uint32_t count = wasm.get_wasm_ptr("get_instance_count");
+                     auto* data = static_cast<const InstanceData*>(wasm.get_memory_ptr(wasm.get_wasm_ptr("get_instance_ptr")));
+                     instances.upload(glState, data, count);
+                  }
+                  instances.draw(glState);
+               }
+               {
+                  GpuScope scope(gpu, "text");
+                  drawText(logViewer ? &logViewer->window() : nullptr);
+               }
+            });
+      }
+
+      const FrameStats& frames = nativeWin.getFrameStats();
+      const FrameStats& cpuFrames = nativeWin.getCpuFrameStats();
+      std::cout << "Frame time p50: " << frames.p50() << " ms, p99: " << frames.p99() << " ms (" << instances.count() << " instances)" << std::endl;
+      std::cout << "CPU submit p50: " << cpuFrames.p50() << " ms, p99: " << cpuFrames.p99() << " ms" << std::endl;
+      std::cout << nativeWin.getGpuProfiler().summary();
+      std::cout << "CPU usage: " << nativeWin.getCpuUsage() * 100.0 << "% of one core" << std::endl;
+      std::cout << "Time to first text: " << firstTextMs << " ms ("
+                << (cachedGlyphs ? std::to_string(cachedGlyphs) + " glyphs from cache" : std::string("cold glyph cache")) << ")" << std::endl;
+      if (logViewer) {
+         std::cout << "Log viewer: " << logViewer->getStats().queries << " queries, " << logViewer->getStats().rowsFetched
+                   << " rows fetched" << std::endl;
+      }
+      glyphCache.save(fonts);
+
+      nativeWin.setFrameCapture(nullptr, 0, "");
+
+      // The widget's context joins the window's share group (see
+      // SharedGpuResources::shareWithQt), so it draws the WASM triangle and
+      // the title from the buffer and atlas texture uploaded above
+      if (qtWidget && !nativeWin.isHeadless()) {
+         glfwHideWindow(nativeWin.getWindow());
+         QWidget mainContainer;
+         QVBoxLayout *layout = new QVBoxLayout(&mainContainer);
+
+         QPushButton *btn = new QPushButton("Refresh Wasm Data");
+         MyGLWidget *glWidget = new MyGLWidget();
 
-      QObject::connect(btn, &QPushButton::clicked, [glWidget, triangle_data_ptr, data_size]() {
-         qDebug() << "Refreshing triangle data...";
          glWidget->setVertexData(triangle_data_ptr, data_size);
-         glWidget->update();
-      });
+         glWidget->setSharedResources(&sharedGpu, "wasm_triangle");
+         glWidget->setTextSource(fonts.getAtlas(), [&](TextRenderer& widgetText) {
+            glyphRasterizer.publish(fonts.getAtlas());
+            widgetText.addText(fonts, title, 16.0f, 56.0f);
+         });
+
+         QObject::connect(btn, &QPushButton::clicked, [glWidget, triangle_data_ptr, data_size]() {
+            qDebug() << "Refreshing triangle data...";
+            glWidget->setVertexData(triangle_data_ptr, data_size);
+            glWidget->update();
+         });
 
-      layout->addWidget(btn);
-      layout->addWidget(glWidget);
+         layout->addWidget(btn);
+         layout->addWidget(glWidget);
 
-      mainContainer.resize(SCR_WIDTH, SCR_HEIGHT);
-      mainContainer.show();
+         mainContainer.resize(SCR_WIDTH, SCR_HEIGHT);
+         mainContainer.show();
+         app.exec();
 
-      return app.exec();
-*/
+         std::cout << "Qt widget: " << (glWidget->usesSharedBuffer() ? "shared" : "private copy of the") << " triangle buffer, "
+                   << glWidget->textGlyphsDrawn() << " glyphs from the shared atlas" << std::endl;
+         // The widget deletes its objects in its own context; the rest of
+         // the share group goes from the window's
+      }
+      nativeWin.makeContextCurrent();
+      sharedGpu.release(glState);
    } catch (const std::exception& e) {
       std::cerr << "Fatal Error: " << e.what() << std::endl;
       return 1;
@@ -53,3 +53,62 @@ export fn get_vertex_count() usize {
 //      v.x += @sin(timer) * 0.001;
 //   }
 //}
+
+// Per-instance data read by the host straight out of linear memory.
+// Layout must match InstanceData in include/instance_renderer.h.
+const Instance = extern struct {
+   transform: [16]f32, // column-major
+   color: [4]f32,
+};
+
+const max_instances = 100_000;
+var instances: [max_instances]Instance = undefined;
+var instance_count: usize = 0;
+var instance_time: f32 = std.math.nan(f32); // time the instances were laid out for
+var instances_dirty: bool = false;
+
+export fn get_instance_ptr() [*]Instance {
+   return &instances;
+}
+
+export fn get_instance_count() usize {
+   return instance_count;
+}
+
+// Lays out `count` copies of the triangle on a grid, each spinning over time.
+// Only marks the instances dirty when the count or the time changed, so a
+// host passing a fixed time gets nothing to repaint after the first call.
+export fn update_instances(count: u32, time: f32) void {
+   const new_count = @min(count, max_instances);
+   if (new_count == instance_count and time == instance_time) return;
+   instance_count = new_count;
+   instance_time = time;
+   instances_dirty = true;
+   if (instance_count == 0) return;
+
+   const side: usize = @intFromFloat(@ceil(@sqrt(@as(f32, @floatFromInt(instance_count)))));
+   const cell = 2.0 / @as(f32, @floatFromInt(side));
+
+   for (instances[0..instance_count], 0..) |*inst, i| {
+      const col: f32 = @floatFromInt(i % side);
+      const row: f32 = @floatFromInt(i / side);
+      const angle = time + @as(f32, @floatFromInt(i)) * 0.01;
+      const c = @cos(angle) * cell;
+      const s = @sin(angle) * cell;
+
+      inst.transform = .{
+         c,                         s,                         0, 0,
+         -s,                        c,                         0, 0,
+         0,                         0,                         1, 0,
+         -1.0 + (col + 0.5) * cell, -1.0 + (row + 0.5) * cell, 0, 1,
+      };
+      inst.color = .{ col / @as(f32, @floatFromInt(side)), row / @as(f32, @floatFromInt(side)), 1.0, 1.0 };
+   }
+}
+
+// Host polls this once per step to decide whether the overlay needs a repaint
+export fn take_dirty() u32 {
+   const was_dirty = instances_dirty;
+   instances_dirty = false;
+   return @intFromBool(was_dirty);
+}
@@ -0,0 +1,6 @@
+#version 440 core
+out vec4 FragColor;
+in vec3 ourColor;
+void main() {
+   FragColor = vec4(ourColor, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 440 core
+// Attribute layout: 0 position, 1 color, 2-5 instance transform, 6 instance color
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in mat4 iTransform;
+layout (location = 6) in vec4 iColor;
+out vec3 ourColor;
+void main() {
+   gl_Position = iTransform * vec4(aPos, 1.0);
+   ourColor = aColor * iColor.rgb;
+}